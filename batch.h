@@ -0,0 +1,196 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/**
+ * Batched matrix operations in an interleaved, matrix-per-lane layout.
+ *
+ * A t_mat_batch holds BATCH_WIDTH matrices with every element stored as a
+ * run of lanes, m[i][j][lane]. Operations are the ordinary matrix kernels run
+ * with a t_lanes in place of T, so each arithmetic step is a component-wise
+ * operation across matrices, which the optimiser turns into SIMD. A batch of
+ * 8 costs about as much as a single scalar matrix.
+ *
+ * Arrays of ordinary matrices convert to and from batches with batch_pack()
+ * and batch_unpack(). Unused lanes of a final partial batch are padded with
+ * identity matrices so inverses stay finite.
+ */
+
+#include "vec.h"
+#include "mat.h"
+
+#define BATCH_WIDTH 8
+
+/**
+ * One scalar per lane. Unlike t_vecn this is left uninitialised and keeps
+ * every operator a single loop, so kernels written against it inline fully
+ * and vectorise at -O2.
+ */
+template<typename T, size_t width>
+struct t_lanes {
+	T v[width];
+
+	t_lanes() {}
+
+	t_lanes(T in) {
+		for(size_t l = 0; l < width; ++l)
+			v[l] = in;
+	}
+
+	T& operator[](size_t l) {
+		return v[l];
+	}
+
+	const T& operator[](size_t l) const {
+		return v[l];
+	}
+
+	t_lanes operator+(const t_lanes &o) const {
+		t_lanes out;
+		for(size_t l = 0; l < width; ++l)
+			out.v[l] = v[l] + o.v[l];
+		return out;
+	}
+
+	t_lanes operator-(const t_lanes &o) const {
+		t_lanes out;
+		for(size_t l = 0; l < width; ++l)
+			out.v[l] = v[l] - o.v[l];
+		return out;
+	}
+
+	t_lanes operator*(const t_lanes &o) const {
+		t_lanes out;
+		for(size_t l = 0; l < width; ++l)
+			out.v[l] = v[l] * o.v[l];
+		return out;
+	}
+
+	t_lanes operator/(const t_lanes &o) const {
+		t_lanes out;
+		for(size_t l = 0; l < width; ++l)
+			out.v[l] = v[l] / o.v[l];
+		return out;
+	}
+
+	t_lanes& operator+=(const t_lanes &o) {
+		for(size_t l = 0; l < width; ++l)
+			v[l] += o.v[l];
+		return *this;
+	}
+
+	t_lanes operator-() const {
+		t_lanes out;
+		for(size_t l = 0; l < width; ++l)
+			out.v[l] = -v[l];
+		return out;
+	}
+};
+
+template<typename matT, size_t width = BATCH_WIDTH>
+struct t_mat_batch {
+	typedef typename matT::value_type T;
+	typedef t_lanes<T, width> lane_type;
+	static constexpr size_t rows = matT::rows;
+	static constexpr size_t cols = matT::cols;
+
+	lane_type m[rows][cols];
+};
+
+/**
+ * Number of batches needed for 'count' matrices.
+ */
+template<size_t width = BATCH_WIDTH>
+static size_t batch_count(size_t count) {
+	return (count + width - 1) / width;
+}
+
+template<typename matT, size_t width>
+static void batch_pack(const matT *in, size_t count,
+		t_mat_batch<matT, width> *out) {
+	const matT identity;
+
+	for(size_t b = 0; b < batch_count<width>(count); ++b) {
+		for(size_t l = 0; l < width; ++l) {
+			size_t n = b * width + l;
+			const matT &src = n < count ? in[n] : identity;
+			for(size_t i = 0; i < matT::rows; ++i)
+				for(size_t j = 0; j < matT::cols; ++j)
+					out[b].m[i][j][l] = src[i][j];
+		}
+	}
+}
+
+template<typename matT, size_t width>
+static void batch_unpack(const t_mat_batch<matT, width> *in, size_t count,
+		matT *out) {
+	for(size_t n = 0; n < count; ++n) {
+		const t_mat_batch<matT, width> &src = in[n / width];
+		for(size_t i = 0; i < matT::rows; ++i)
+			for(size_t j = 0; j < matT::cols; ++j)
+				out[n][i][j] = src.m[i][j][n % width];
+	}
+}
+
+/**
+ * out = a * b per lane, for 'batches' batches of square matrices.
+ */
+template<typename matT, size_t width>
+static void batch_mul(const t_mat_batch<matT, width> *a,
+		const t_mat_batch<matT, width> *b, t_mat_batch<matT, width> *out,
+		size_t batches) {
+	static_assert(matT::rows == matT::cols, "batch_mul requires square");
+	typedef typename t_mat_batch<matT, width>::lane_type lane_type;
+
+	for(size_t x = 0; x < batches; ++x) {
+		t_mat_batch<matT, width> t;
+		for(size_t i = 0; i < matT::rows; ++i) {
+			for(size_t j = 0; j < matT::cols; ++j) {
+				lane_type s = a[x].m[0][j] * b[x].m[i][0];
+				for(size_t k = 1; k < matT::rows; ++k)
+					s += a[x].m[k][j] * b[x].m[i][k];
+				t.m[i][j] = s;
+			}
+		}
+		out[x] = t;
+	}
+}
+
+template<typename matT, size_t width>
+static void batch_transpose(const t_mat_batch<matT, width> *in,
+		t_mat_batch<matT, width> *out, size_t batches) {
+	static_assert(matT::rows == matT::cols, "batch_transpose requires square");
+
+	for(size_t x = 0; x < batches; ++x) {
+		t_mat_batch<matT, width> t;
+		for(size_t i = 0; i < matT::rows; ++i)
+			for(size_t j = 0; j < matT::cols; ++j)
+				t.m[i][j] = in[x].m[j][i];
+		out[x] = t;
+	}
+}
+
+/**
+ * Per-lane inverse of 'batches' batches of mat3 or mat4. Lanes holding
+ * singular matrices are undefined.
+ */
+template<typename T, size_t width>
+static void batch_inverse(const t_mat_batch<t_mat3x3<T>, width> *in,
+		t_mat_batch<t_mat3x3<T>, width> *out, size_t batches) {
+	for(size_t x = 0; x < batches; ++x) {
+		t_mat_batch<t_mat3x3<T>, width> t;
+		invert_3x3<t_lanes<T, width>>(in[x].m, t.m);
+		out[x] = t;
+	}
+}
+
+template<typename T, size_t width>
+static void batch_inverse(const t_mat_batch<t_mat4x4<T>, width> *in,
+		t_mat_batch<t_mat4x4<T>, width> *out, size_t batches) {
+	for(size_t x = 0; x < batches; ++x) {
+		t_mat_batch<t_mat4x4<T>, width> t;
+		invert_4x4<t_lanes<T, width>>(in[x].m, t.m);
+		out[x] = t;
+	}
+}
+
+#endif
@@ -0,0 +1,242 @@
+#if 0
+set -e
+CXX=${CXX:-g++}
+for inline in "" -DT_VEC_FORCE_INLINE; do
+	for opt in -O0 -Og -O2; do
+		echo "$opt $inline"
+		def=
+		if [ $opt = -Og ]; then def=-DBENCH_OG; fi
+		$CXX $opt $def $inline -Wall -std=c++11 bench.cpp && ./a.out
+	done
+	if $CXX --version | grep -q "Free Software"; then
+		$CXX -O2 $inline -std=c++11 -fopt-info-vec-optimized=vec.txt \
+			-c bench.cpp -o /dev/null
+		for line in $(grep -n "/[*] vectorised at -O2 [*]/" bench.cpp |
+				cut -d: -f1); do
+			grep -q "^bench.cpp:$line:.*loop vectorized" vec.txt ||
+				{ echo "line $line not vectorised at -O2 $inline"; exit 1; }
+		done
+		rm vec.txt
+	fi
+done
+exit
+#endif
+
+/**
+ * Compares the vector and matrix types against handwritten structs on small
+ * workloads: particle integration with vec3, transforming vec4s by a mat4,
+ * and advancing positions by velocities through the vec3 bulk functions.
+ * Prints the best of several runs of each, and the ratio of the library's
+ * time to the handwritten time.
+ *
+ * In unoptimised builds this shows the effect of T_VEC_FORCE_INLINE; at -O2
+ * the bulk row shows the gain from vectorised loops over arrays.
+ *
+ * With GCC the script also checks the -fopt-info report for every loop
+ * marked "vectorised at -O2", so a change to the vec3 or mat4 layout that
+ * stops those loops vectorising fails even when timing noise would hide it.
+ *
+ * Exits non-zero when a ratio exceeds its limit below. Ratios rather than
+ * times are checked so the limits hold across machines; they leave room for
+ * timing noise but not for losing inlining or vectorisation.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+
+#include "vec.h"
+#include "mat.h"
+
+struct hvec3 {
+	float x, y, z;
+};
+
+static inline hvec3 operator+(const hvec3 &a, const hvec3 &b) {
+	hvec3 out = { a.x + b.x, a.y + b.y, a.z + b.z };
+	return out;
+}
+
+static inline hvec3 operator*(const hvec3 &a, float s) {
+	hvec3 out = { a.x * s, a.y * s, a.z * s };
+	return out;
+}
+
+struct hvec4 {
+	float x, y, z, w;
+};
+
+struct hmat4 {
+	hvec4 c[4];
+};
+
+static inline hvec4 operator+(const hvec4 &a, const hvec4 &b) {
+	hvec4 out = { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w };
+	return out;
+}
+
+static inline hvec4 operator*(const hvec4 &a, float s) {
+	hvec4 out = { a.x * s, a.y * s, a.z * s, a.w * s };
+	return out;
+}
+
+static inline hvec4 transform(const hmat4 &m, const hvec4 &v) {
+	return m.c[0] * v.x + m.c[1] * v.y + m.c[2] * v.z + m.c[3] * v.w;
+}
+
+/*
+ * Array kernels are kept out of line, as in real code, so the compiler cannot
+ * see that the arrays are distinct globals.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#define BENCH_OPAQUE __attribute__((noipa))
+#else
+#define BENCH_OPAQUE __attribute__((noinline))
+#endif
+
+BENCH_OPAQUE
+static void hand_advance(hvec3 *pos, const hvec3 *vel, float dt, size_t n) {
+	for(size_t i = 0; i < n; ++i)
+		pos[i] = pos[i] + vel[i] * dt;
+}
+
+BENCH_OPAQUE
+static void crtp_advance(vec3 *pos, const vec3 *vel, float dt, size_t n) {
+	vec3::add_scaled(pos, vel, dt, pos, n);
+}
+
+/* Prints a row, returning whether its ratio is within 'limit'. */
+static bool row(const char *name, const char *kind, double hand, double crtp,
+		double limit) {
+	double ratio = crtp / hand;
+	bool ok = ratio <= limit;
+	printf("%-10s hand %6.2fms %s %6.2fms ratio %.2f (limit %.2f)%s\n",
+			name, hand * 1e3, kind, crtp * 1e3, ratio, limit,
+			ok ? "" : "  FAIL");
+	return ok;
+}
+
+static double now() {
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+#define COUNT 1000
+#define RUNS 10
+
+/*
+ * Highest accepted library / handwritten time ratios, per build, set about
+ * 1.2x above the worst ratios measured with GCC 12 over 20 runs. -Og defines
+ * the same macros as -O2, so the script passes BENCH_OG to give it its own
+ * limits; without T_VEC_FORCE_INLINE it calls mat4::transform out of line,
+ * hence its loose transform limit.
+ */
+#if defined(BENCH_OG) && defined(T_VEC_FORCE_INLINE)
+#define LIMIT_INTEGRATE 1.75
+#define LIMIT_TRANSFORM 0.55
+#define LIMIT_ADVANCE 0.25
+#elif defined(BENCH_OG)
+#define LIMIT_INTEGRATE 1.6
+#define LIMIT_TRANSFORM 3.8
+#define LIMIT_ADVANCE 0.25
+#elif defined(__OPTIMIZE__) && defined(T_VEC_FORCE_INLINE)
+#define LIMIT_INTEGRATE 1.5
+#define LIMIT_TRANSFORM 1.25
+#define LIMIT_ADVANCE 1.25
+#elif defined(__OPTIMIZE__)
+#define LIMIT_INTEGRATE 1.5
+#define LIMIT_TRANSFORM 1.25
+#define LIMIT_ADVANCE 1.2
+#elif defined(T_VEC_FORCE_INLINE)
+#define LIMIT_INTEGRATE 1.75
+#define LIMIT_TRANSFORM 1.65
+#define LIMIT_ADVANCE 0.95
+#else
+#define LIMIT_INTEGRATE 2.3
+#define LIMIT_TRANSFORM 2.75
+#define LIMIT_ADVANCE 0.95
+#endif
+
+static hvec3 hpos[COUNT], hvel[COUNT];
+static vec3 pos[COUNT], vel[COUNT];
+static hvec4 hpoints[COUNT];
+static vec4 points[COUNT];
+
+int main() {
+	for(size_t i = 0; i < COUNT; ++i) {
+		hpos[i] = { float(i), 0, 0 };
+		hvel[i] = { 1, 2, 3 };
+		pos[i] = vec3(float(i), 0, 0);
+		vel[i] = vec3(1, 2, 3);
+		hpoints[i] = { 1, 2, 3, 1 };
+		points[i] = vec4(1, 2, 3, 1);
+	}
+
+	const float dt = 0.001f;
+	const hvec3 hgravity = { 0, -9.8f, 0 };
+	const vec3 gravity(0, -9.8f, 0);
+
+	hmat4 hm = {{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 },
+		{ 1, 2, 3, 1 } }};
+	mat4 m;
+	m[3] = vec4(1, 2, 3, 1);
+
+	double hand_integrate = 1e9, crtp_integrate = 1e9;
+	double hand_transform = 1e9, crtp_transform = 1e9;
+	double hand_bulk = 1e9, crtp_bulk = 1e9;
+
+	for(size_t run = 0; run < RUNS; ++run) {
+		double t0 = now();
+		for(size_t k = 0; k < 200; ++k) {
+			for(size_t i = 0; i < COUNT; ++i) {
+				hvel[i] = hvel[i] + hgravity * dt;
+				hpos[i] = hpos[i] + hvel[i] * dt;
+			}
+		}
+
+		double t1 = now();
+		for(size_t k = 0; k < 200; ++k) {
+			for(size_t i = 0; i < COUNT; ++i) { /* vectorised at -O2 */
+				vel[i] = vel[i] + gravity * dt;
+				pos[i] = pos[i] + vel[i] * dt;
+			}
+		}
+
+		double t2 = now();
+		for(size_t k = 0; k < 100; ++k)
+			for(size_t i = 0; i < COUNT; ++i)
+				hpoints[i] = transform(hm, hpoints[i]);
+
+		double t3 = now();
+		for(size_t k = 0; k < 100; ++k)
+			for(size_t i = 0; i < COUNT; ++i) /* vectorised at -O2 */
+				points[i] = mat4::transform(m, points[i]);
+
+		double t4 = now();
+		for(size_t k = 0; k < 1000; ++k)
+			hand_advance(hpos, hvel, dt, COUNT);
+
+		double t5 = now();
+		for(size_t k = 0; k < 1000; ++k)
+			crtp_advance(pos, vel, dt, COUNT);
+
+		double t6 = now();
+		hand_integrate = fmin(hand_integrate, t1 - t0);
+		crtp_integrate = fmin(crtp_integrate, t2 - t1);
+		hand_transform = fmin(hand_transform, t3 - t2);
+		crtp_transform = fmin(crtp_transform, t4 - t3);
+		hand_bulk = fmin(hand_bulk, t5 - t4);
+		crtp_bulk = fmin(crtp_bulk, t6 - t5);
+	}
+
+	bool ok = true;
+	ok &= row("integrate:", "crtp", hand_integrate, crtp_integrate,
+			LIMIT_INTEGRATE);
+	ok &= row("transform:", "crtp", hand_transform, crtp_transform,
+			LIMIT_TRANSFORM);
+	ok &= row("advance:", "bulk", hand_bulk, crtp_bulk, LIMIT_ADVANCE);
+
+	/* Keep the results live. */
+	printf("(%g %g)\n", hpos[5].y + pos[5].y, hpoints[3].x + points[3].x);
+	return ok ? 0 : 1;
+}
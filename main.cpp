@@ -1,10 +1,15 @@
 #if 0
-time clang++ -fno-exceptions -fno-rtti -Wall -std=c++11 main.cpp && ./a.out
+set -e
+CXX=${CXX:-g++}
+for opt in -O0 -O2; do
+	$CXX $opt -fno-exceptions -fno-rtti -Wall -std=c++11 -pthread main.cpp && ./a.out
+done
+CXX=$CXX sh bench.cpp
 exit
 #endif
 
 /**
- * CRTP vector example. Classes defined:
+ * CRTP vector tests. Classes covered:
  *   - vec2
  *   - vec3
  *   - vec4
@@ -14,186 +19,1994 @@ exit
  *   - mat3x2
  *   - mat3
  *   - mat3x4
- *   - mat3x2
+ *   - mat4x2
  *   - mat4x3
  *   - mat4
+ *   - t_vecn and t_matn, as 6 and 5x6 sized examples
  *
  *   The above are all typedefs of t_type<float>.
  *
- *   All vectors can:
- *     - + - / * other vectors of the same type, or their data type
- *     - shorthand + - / * with the same type T, or their own type
- *     - negate (-type)
- *     - compare
- *     - access through square brackets
+ * Every operation is run on random inputs and compared with a scalar
+ * reference computed in double. Errors are measured in float ulps of the
+ * reference, or for sums of terms, of the sum of their magnitudes, so
+ * cancellation in the inputs is not counted against the kernel. Exact
+ * operations must round correctly (0.5 ulp). Batched and bulk kernels are
+ * held to the same limits as the scalar functions they replace.
+ *
+ * The threaded headers are checked against scalar or brute force
+ * references with one thread, a few, and more than PARALLEL_MAX_THREADS;
+ * the transform store with readers running alongside its writer.
  *
- *   Vectors have direct member access through .xyzw/.rgba members
+ * Prints the worst error of each check against its limit and exits non-zero
+ * if any check fails. An optional argument sets the random seed.
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+#define T_VEC_SWIZZLE_ALL
 #include "vec.h"
 #include "mat.h"
+#include "trig.h"
+#include "batch.h"
+#include "reduce.h"
+#include "skin.h"
+#include "solve.h"
+#include "spline.h"
+#include "rte.h"
+#include "mesh.h"
+#include "spatial.h"
+#include "transform_store.h"
+#include "stream.h"
+
+#define ITERATIONS 1000
+#define BULK_COUNT 150
+#define MAX_RESULTS 512
+
+/**********************************
+ * Random inputs
+ **********************************/
+
+static uint64_t rng_state;
+
+uint32_t random_bits() {
+	/* xorshift64* */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return static_cast<uint32_t>((rng_state * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+/* Uniform in [lo, hi). */
+float random_range(float lo, float hi) {
+	return lo + (hi - lo) * (random_bits() >> 8) * (1.0f / (1 << 24));
+}
 
 /**
- * Run through all implemented operators for vec/mat types.
- * Modifies input values.
+ * Either sign, magnitudes spread over 2^-8 to 2^8 so every operation sees a
+ * range of exponents. Never 0, so it is safe to divide by.
+ */
+float random_value() {
+	float m = random_range(1, 2);
+	int e = static_cast<int>(random_bits() % 17) - 8;
+	return (random_bits() & 1 ? -1 : 1) * ldexpf(m, e);
+}
+
+/**********************************
+ * Component access
+ *
+ * Vectors and matrices as a flat list of components, so the element-wise
+ * checks run over both.
+ **********************************/
+
+template<typename T, size_t len, typename t_vecx, typename members>
+size_t components(const t_vec<T, len, t_vecx, members> &) {
+	return len;
+}
+
+template<typename T, size_t len, typename t_vecx, typename members>
+T& component(t_vec<T, len, t_vecx, members> &v, size_t i) {
+	return v[i];
+}
+
+template<typename T, typename Row, typename Col, typename t_matxx>
+size_t components(const t_mat<T, Row, Col, t_matxx> &) {
+	return Row::length * Col::length;
+}
+
+template<typename T, typename Row, typename Col, typename t_matxx>
+T& component(t_mat<T, Row, Col, t_matxx> &m, size_t i) {
+	return m[i / Col::length][i % Col::length];
+}
+
+template<typename typeT>
+float get(const typeT &in, size_t i) {
+	return component(const_cast<typeT&>(in), i);
+}
+
+template<typename typeT>
+typeT random_of() {
+	typeT out;
+	for(size_t i = 0; i < components(out); ++i)
+		component(out, i) = random_value();
+	return out;
+}
+
+/**********************************
+ * Checks and error reporting
+ **********************************/
+
+/**
+ * Reference result in double, and the magnitude its error is measured at:
+ * the result itself, or the sum of the absolute terms for sums.
+ */
+struct t_ref {
+	double value;
+	double scale;
+
+	t_ref(double v) : value(v), scale(fabs(v)) {}
+	t_ref(double v, double s) : value(v), scale(s > fabs(v) ? s : fabs(v)) {}
+};
+
+/* Running sum for references, tracking the largest possible term sum. */
+struct t_sum {
+	double value;
+	double scale;
+
+	t_sum() : value(0), scale(0) {}
+
+	void add(double term) {
+		value += term;
+		scale += fabs(term);
+	}
+
+	operator t_ref() const {
+		return t_ref(value, scale);
+	}
+};
+
+/**
+ * Error of 'got' in float ulps at the reference's scale. NaN matches NaN.
+ */
+double ulps(float got, const t_ref &ref) {
+	if(isnan(got) || isnan(ref.value))
+		return isnan(got) && isnan(ref.value) ? 0 : INFINITY;
+	if(got == ref.value)
+		return 0;
+
+	int e;
+	frexp(ref.scale, &e);
+	double ulp = ldexp(1.0, e - 24 > -149 ? e - 24 : -149);
+	return fabs(got - ref.value) / ulp;
+}
+
+struct t_result {
+	const char *label;
+	const char *check;
+	char name[40];
+	double limit;
+	double worst;
+	size_t checks;
+};
+
+t_result results[MAX_RESULTS];
+size_t result_count;
+
+/**
+ * The result for a check, found by the addresses of its label and name.
+ * Checks mostly repeat or follow the previous one, so the search starts
+ * there.
+ */
+t_result& result(const char *label, const char *name, double limit) {
+	static size_t last = 0;
+	for(size_t k = 0; k < result_count; ++k) {
+		size_t i = (last + k) % result_count;
+		if(results[i].label == label && results[i].check == name) {
+			last = i;
+			return results[i];
+		}
+	}
+
+	char full[40];
+	snprintf(full, sizeof(full), "%s %s", label, name);
+
+	if(result_count == MAX_RESULTS) {
+		printf("too many checks, raise MAX_RESULTS\n");
+		exit(1);
+	}
+
+	last = result_count;
+	t_result &r = results[result_count++];
+	r.label = label;
+	r.check = name;
+	memcpy(r.name, full, sizeof(full));
+	r.limit = limit;
+	r.worst = 0;
+	r.checks = 0;
+	return r;
+}
+
+void check(const char *label, const char *name, double limit, float got,
+		const t_ref &ref) {
+	t_result &r = result(label, name, limit);
+	double u = ulps(got, ref);
+	++r.checks;
+	if(u > r.worst)
+		r.worst = u;
+}
+
+/* Checks with no error to measure. */
+void check(const char *label, const char *name, bool ok) {
+	t_result &r = result(label, name, 0);
+	++r.checks;
+	if(!ok)
+		r.worst = INFINITY;
+}
+
+/**
+ * Check every component of 'got' against ref(i).
+ */
+template<typename typeT, typename F>
+void check_each(const char *label, const char *name, double limit,
+		const typeT &got, F ref) {
+	for(size_t i = 0; i < components(got); ++i)
+		check(label, name, limit, get(got, i), ref(i));
+}
+
+int report() {
+	int failed = 0;
+
+	printf("%-36s %8s %10s %8s\n", "check", "count", "worst ulp", "limit");
+	for(size_t i = 0; i < result_count; ++i) {
+		const t_result &r = results[i];
+		bool fail = !(r.worst <= r.limit);
+		printf("%-36s %8zu %10.3g %8.3g%s\n", r.name, r.checks, r.worst,
+				r.limit, fail ? "  FAIL" : "");
+		failed += fail;
+	}
+
+	printf("\n%zu checks, %d failed\n", result_count, failed);
+	return failed;
+}
+
+/**********************************
+ * Shared vector and matrix tests
+ **********************************/
+
+/**
+ * Run through all implemented operators for vec/mat types, element-wise.
  */
 template<typename T>
-void operator_test(T &a, T &b, void(*print_fnc)(const T&))
+void operator_test(const char *label, const T &a, const T &b, float s)
 {
+	const double x = s;
 	T c;
 
 	/* Full operators */
-	printf("\n");
+	check_each(label, "a + b", 0.5, a + b,
+			[&](size_t i) { return t_ref(double(get(a, i)) + get(b, i)); });
+	check_each(label, "a - b", 0.5, a - b,
+			[&](size_t i) { return t_ref(double(get(a, i)) - get(b, i)); });
+	check_each(label, "a * b", 0.5, a * b,
+			[&](size_t i) { return t_ref(double(get(a, i)) * get(b, i)); });
+	check_each(label, "a / b", 0.5, a / b,
+			[&](size_t i) { return t_ref(double(get(a, i)) / get(b, i)); });
 
-	c = a + b;
-	printf("a + b:\t"); print_fnc(c);
+	/* Full operators with data */
+	check_each(label, "a + s", 0.5, a + s,
+			[&](size_t i) { return t_ref(get(a, i) + x); });
+	check_each(label, "a - s", 0.5, a - s,
+			[&](size_t i) { return t_ref(get(a, i) - x); });
+	check_each(label, "a * s", 0.5, a * s,
+			[&](size_t i) { return t_ref(get(a, i) * x); });
+	check_each(label, "a / s", 0.5, a / s,
+			[&](size_t i) { return t_ref(get(a, i) / x); });
 
-	c = a - b;
-	printf("a - b:\t"); print_fnc(c);
+	/* Shorthands with vectors */
+	c = a; c += b;
+	check_each(label, "a += b", 0.5, c,
+			[&](size_t i) { return t_ref(double(get(a, i)) + get(b, i)); });
+	c = a; c -= b;
+	check_each(label, "a -= b", 0.5, c,
+			[&](size_t i) { return t_ref(double(get(a, i)) - get(b, i)); });
+	c = a; c *= b;
+	check_each(label, "a *= b", 0.5, c,
+			[&](size_t i) { return t_ref(double(get(a, i)) * get(b, i)); });
+	c = a; c /= b;
+	check_each(label, "a /= b", 0.5, c,
+			[&](size_t i) { return t_ref(double(get(a, i)) / get(b, i)); });
 
-	c = a * b;
-	printf("a * b:\t"); print_fnc(c);
+	/* Shorthands with data */
+	c = a; c += s;
+	check_each(label, "a += s", 0.5, c,
+			[&](size_t i) { return t_ref(get(a, i) + x); });
+	c = a; c -= s;
+	check_each(label, "a -= s", 0.5, c,
+			[&](size_t i) { return t_ref(get(a, i) - x); });
+	c = a; c *= s;
+	check_each(label, "a *= s", 0.5, c,
+			[&](size_t i) { return t_ref(get(a, i) * x); });
+	c = a; c /= s;
+	check_each(label, "a /= s", 0.5, c,
+			[&](size_t i) { return t_ref(get(a, i) / x); });
 
-	c = a / b;
-	printf("a / b:\t"); print_fnc(c);
+	check_each(label, "-a", 0, -a,
+			[&](size_t i) { return t_ref(-get(a, i)); });
 
-	/* Full operators  with data */
-	printf("\n");
+	/* Comparison, with b differing from a in one random component */
+	c = a;
+	component(c, random_bits() % components(c)) += 1;
+	check(label, "==", a == a && !(a == c));
+	check(label, "!=", !(a != a) && a != c);
+}
 
-	c = a + 4;
-	printf("a + 4:\t"); print_fnc(c);
+/**********************************
+ * Vector tests
+ **********************************/
 
-	c = a - 2;
-	printf("a - 4:\t"); print_fnc(c);
+/**
+ * Bulk kernels into a separate output, then in place over 'a' and over 'b',
+ * on a count spanning several blocks and a remainder.
+ */
+template<typename vecT>
+void bulk_test(const char *label) {
+	static const char *names[] = {
+		"bulk add", "bulk sub", "bulk mul", "bulk scale", "bulk add_scaled"
+	};
+	static vecT a[BULK_COUNT], b[BULK_COUNT];
+	static vecT ia[BULK_COUNT], ib[BULK_COUNT], out[BULK_COUNT];
+	float s = random_value();
 
-	c = a * 2;
-	printf("a * 4:\t"); print_fnc(c);
+	for(size_t k = 0; k < BULK_COUNT; ++k) {
+		a[k] = random_of<vecT>();
+		b[k] = random_of<vecT>();
+	}
 
-	c = a / 2;
-	printf("a / 4:\t"); print_fnc(c);
+	for(int alias = 0; alias < 3; ++alias) {
+		for(int f = 0; f < 5; ++f) {
+			memcpy(ia, a, sizeof(a));
+			memcpy(ib, b, sizeof(b));
+			vecT *dst = alias == 0 ? out : (alias == 1 ? ia : ib);
+			vecT *src = alias == 2 ? ib : ia;
 
-	/* Shorthands with vectors */
-	printf("\n");
+			switch(f) {
+			case 0: vecT::add(ia, ib, dst, BULK_COUNT); break;
+			case 1: vecT::sub(ia, ib, dst, BULK_COUNT); break;
+			case 2: vecT::mul(ia, ib, dst, BULK_COUNT); break;
+			case 3: vecT::scale(src, s, dst, BULK_COUNT); break;
+			case 4: vecT::add_scaled(ia, ib, s, dst, BULK_COUNT); break;
+			}
 
-	a += b;
-	printf("a += b:\t"); print_fnc(a);
+			for(size_t k = 0; k < BULK_COUNT; ++k) {
+				for(size_t i = 0; i < vecT::length; ++i) {
+					double x = a[k][i], y = b[k][i];
+					const t_ref ref[] = {
+						t_ref(x + y), t_ref(x - y), t_ref(x * y),
+						t_ref((alias == 2 ? y : x) * s),
+						t_ref(x + y * s, fabs(x) + fabs(y * s))
+					};
+					/* add_scaled may contract to a fused multiply-add. */
+					check(label, names[f], f == 4 ? 1 : 0.5, dst[k][i],
+							ref[f]);
+				}
+			}
+		}
+	}
+}
 
-	a -= b;
-	printf("a -= b:\t"); print_fnc(a);
+/**
+ * Reference blend of four vectors with double weights. 'ws' is the size of
+ * the terms each weight is evaluated from, as weights near 0 are only known
+ * to within an ulp of those.
+ */
+template<typename vecT>
+t_ref blend_ref(const vecT *p, const double *w, const double *ws, size_t i) {
+	double out = 0, scale = 0;
+	for(size_t k = 0; k < 4; ++k) {
+		out += w[k] * p[k][i];
+		scale += ws[k] * fabs(p[k][i]);
+	}
+	return t_ref(out, scale);
+}
 
-	a *= b;
-	printf("a *= b:\t"); print_fnc(a);
+/**
+ * Weights of each spline basis at 'u' in double, with their term sizes for
+ * blend_ref().
+ */
+void ref_weights(spline_hermite, double u, double *w, double *ws) {
+	double u2 = u * u, u3 = u2 * u;
+	const double v[] = {
+		2 * u3 - 3 * u2 + 1, u3 - 2 * u2 + u, -2 * u3 + 3 * u2, u3 - u2
+	};
+	const double s[] = {
+		2 * u3 + 3 * u2 + 1, u3 + 2 * u2 + u, 2 * u3 + 3 * u2, u3 + u2
+	};
+	memcpy(w, v, sizeof(v));
+	memcpy(ws, s, sizeof(s));
+}
+
+void ref_weights(spline_catmull_rom, double u, double *w, double *ws) {
+	double u2 = u * u, u3 = u2 * u;
+	const double v[] = {
+		0.5 * (-u3 + 2 * u2 - u), 0.5 * (3 * u3 - 5 * u2 + 2),
+		0.5 * (-3 * u3 + 4 * u2 + u), 0.5 * (u3 - u2)
+	};
+	const double s[] = {
+		0.5 * (u3 + 2 * u2 + u), 0.5 * (3 * u3 + 5 * u2 + 2),
+		0.5 * (3 * u3 + 4 * u2 + u), 0.5 * (u3 + u2)
+	};
+	memcpy(w, v, sizeof(v));
+	memcpy(ws, s, sizeof(s));
+}
 
-	a /= b;
-	printf("a /= b:\t"); print_fnc(a);
+void ref_weights(spline_bezier, double u, double *w, double *ws) {
+	double v = 1 - u;
+	const double b[] = { v * v * v, 3 * u * v * v, 3 * u * u * v, u * u * u };
+	memcpy(w, b, sizeof(b));
+	memcpy(ws, b, sizeof(b));
+}
 
-	/* Shorthands with data */
-	printf("\n");
+void ref_weights(spline_bspline, double u, double *w, double *ws) {
+	double u2 = u * u, u3 = u2 * u, v = 1 - u;
+	const double b[] = {
+		v * v * v / 6, (3 * u3 - 6 * u2 + 4) / 6,
+		(-3 * u3 + 3 * u2 + 3 * u + 1) / 6, u3 / 6
+	};
+	const double s[] = {
+		v * v * v / 6, (3 * u3 + 6 * u2 + 4) / 6,
+		(3 * u3 + 3 * u2 + 3 * u + 1) / 6, u3 / 6
+	};
+	memcpy(w, b, sizeof(b));
+	memcpy(ws, s, sizeof(s));
+}
+
+template<typename vecT>
+void vec_test(const char *label) {
+	const size_t n = vecT::length;
+
+	for(size_t it = 0; it < ITERATIONS; ++it) {
+		vecT a = random_of<vecT>();
+		vecT b = random_of<vecT>();
+		vecT c = random_of<vecT>();
+		float s = random_value();
 
-	a += 4;
-	printf("a += 4:\t"); print_fnc(a);
+		operator_test(label, a, b, s);
 
-	a -= 4;
-	printf("a -= 4:\t"); print_fnc(a);
+		t_sum mag, dist, dot;
+		for(size_t i = 0; i < n; ++i) {
+			double d = double(a[i]) - b[i];
+			mag.add(double(a[i]) * a[i]);
+			dist.add(d * d);
+			dot.add(double(a[i]) * b[i]);
+		}
 
-	a *= 4;
-	printf("a *= 4:\t"); print_fnc(a);
+		/* Sums round once per term. */
+		check(label, "magnitude", 0.5 * n + 1, vecT::magnitude(a),
+				sqrt(mag.value));
+		check(label, "distance_squared", n + 1, vecT::distance_squared(a, b),
+				dist);
+		check(label, "dot", n, vecT::dot(a, b), dot);
+		check(label, "dot zero", vecT::dot(a, vecT(0)) == 0);
+		check(label, "normalise zero", vecT::normalise(vecT(0)) == vecT(0));
+		check_each(label, "normalise", 2, vecT::normalise(a), [&](size_t i) {
+			return t_ref(a[i] / sqrt(mag.value), 1);
+		});
 
-	a /= 4;
-	printf("a /= 4:\t"); print_fnc(a);
+		vecT lo = vecT::min(b, c);
+		vecT hi = vecT::max(b, c);
+		check_each(label, "min", 0, lo,
+				[&](size_t i) { return t_ref(fmin(b[i], c[i])); });
+		check_each(label, "max", 0, hi,
+				[&](size_t i) { return t_ref(fmax(b[i], c[i])); });
+		check_each(label, "abs", 0, vecT::abs(a),
+				[&](size_t i) { return t_ref(fabs(a[i])); });
+		check_each(label, "clamp", 0, vecT::clamp(a, lo, hi), [&](size_t i) {
+			return t_ref(fmin(fmax(a[i], lo[i]), hi[i]));
+		});
 
-	/* Comparison: */
-	printf("\n");
+		/* Interpolation, with t a little outside [0, 1] */
+		float t = random_range(-0.25f, 1.25f);
+		check_each(label, "lerp", 2, vecT::lerp(a, b, t), [&](size_t i) {
+			double d = (double(b[i]) - a[i]) * t;
+			return t_ref(a[i] + d, fabs(a[i]) + fabs(d));
+		});
 
-	printf("a == b:\t%s\n", a == b ? "true" : "false");
-	printf("a != b:\t%s\n", a != b ? "true" : "false");
-	printf("a == a:\t%s\n", a == a ? "true" : "false");
-	printf("a != a:\t%s\n", a != a ? "true" : "false");
+		double e = t < 0 ? 0 : (t > 1 ? 1 : t);
+		e = e * e * (3 - 2 * e);
+		check_each(label, "smooth_lerp", 4, vecT::smooth_lerp(a, b, t),
+				[&](size_t i) {
+			double d = double(b[i]) - a[i];
+			return t_ref(a[i] + d * e, fabs(a[i]) + fabs(d));
+		});
+
+		/* Cubic segments, against the textbook bases in double */
+		const vecT p[] = { a, b, c, random_of<vecT>() };
+		double u = random_range(0, 1);
+		float w[4];
+		for(size_t k = 0; k < 4; ++k)
+			w[k] = random_value();
+
+		const double wf[] = { w[0], w[1], w[2], w[3] };
+		const double wfs[] = { fabs(wf[0]), fabs(wf[1]), fabs(wf[2]),
+			fabs(wf[3]) };
+		double wh[4], whs[4], wc[4], wcs[4], wb[4], wbs[4], ws[4], wss[4];
+		ref_weights(spline_hermite(), u, wh, whs);
+		ref_weights(spline_catmull_rom(), u, wc, wcs);
+		ref_weights(spline_bezier(), u, wb, wbs);
+		ref_weights(spline_bspline(), u, ws, wss);
+
+		float uf = static_cast<float>(u);
+		check_each(label, "blend", 4, vecT::blend(p[0], p[1], p[2], p[3], w),
+				[&](size_t i) { return blend_ref(p, wf, wfs, i); });
+		check_each(label, "hermite", 8,
+				vecT::hermite(p[0], p[1], p[2], p[3], uf),
+				[&](size_t i) { return blend_ref(p, wh, whs, i); });
+		check_each(label, "catmull_rom", 8,
+				vecT::catmull_rom(p[0], p[1], p[2], p[3], uf),
+				[&](size_t i) { return blend_ref(p, wc, wcs, i); });
+		check_each(label, "bezier", 8,
+				vecT::bezier(p[0], p[1], p[2], p[3], uf),
+				[&](size_t i) { return blend_ref(p, wb, wbs, i); });
+		check_each(label, "bspline", 8,
+				vecT::bspline(p[0], p[1], p[2], p[3], uf),
+				[&](size_t i) { return blend_ref(p, ws, wss, i); });
+	}
+
+	bulk_test<vecT>(label);
 }
 
-/* Print vec types */
-template<typename vecT>
-void printv(const vecT &in) {
-	printf("{ ");
-	for(size_t i = 0; i < vecT::length; ++i) {
-		printf("%s%.6f%s", in[i] < 0 ? "" : " ", in[i],
-				i != vecT::length - 1 ? ", " : " }\n");
+void vec3_test() {
+	for(size_t it = 0; it < ITERATIONS; ++it) {
+		vec3 a = random_of<vec3>();
+		vec3 b = random_of<vec3>();
+		vec3 c = vec3::Cross(a, b);
+
+		for(size_t i = 0; i < 3; ++i) {
+			size_t j = (i + 1) % 3, k = (i + 2) % 3;
+			double l = double(a[j]) * b[k], r = double(a[k]) * b[j];
+			check("vec3", "Cross", 1.5, c[i], t_ref(l - r, fabs(l) + fabs(r)));
+		}
+
+		/* Swizzles read and write the selected components. */
+		vec3 zyx = a.zyx();
+		vec2 yx = a.gr();
+		vec3 w = a;
+		w.xz() = vec2(b.x, b.y);
+		check("vec3", "swizzle", zyx == vec3(a.z, a.y, a.x) &&
+				yx == vec2(a.y, a.x) && w == vec3(b.x, a.y, b.y));
+
+		/* Operators work on the selected components in place, including
+		 * from an overlapping vector. */
+		w = a;
+		w.zyx() += w;
+		vec3 u = a;
+		u.yz() *= b.x;
+		vec4 q(a.x, a.y, a.z, b.z);
+		q.wzyx() -= q;
+		check("vec3", "swizzle operators", w == vec3(a.x + a.z, a.y + a.y,
+				a.z + a.x) && u == vec3(a.x, a.y * b.x, a.z * b.x) &&
+				q == vec4(a.x - b.z, a.y - a.z, a.z - a.y, b.z - a.x) &&
+				a.xy() + b.zx() == vec2(a.x + b.z, a.y + b.x) &&
+				-a.yx() == vec2(-a.y, -a.x) && a.zy() / 2.0f ==
+				vec2(a.z / 2.0f, a.y / 2.0f));
+	}
+}
+
+/**********************************
+ * Matrix tests
+ **********************************/
+
+/* Double square matrices for the references, indexed [col][row]. */
+struct t_dmat {
+	double m[4][4];
+	double scale[4][4];
+};
+
+template<typename matT>
+t_dmat to_dmat(const matT &in) {
+	t_dmat out;
+	for(size_t i = 0; i < matT::rows; ++i) {
+		for(size_t j = 0; j < matT::cols; ++j) {
+			out.m[i][j] = in[i][j];
+			out.scale[i][j] = fabs(in[i][j]);
+		}
+	}
+	return out;
+}
+
+/* a * b, with the scale of each element's sum. */
+t_dmat ref_mul(const t_dmat &a, const t_dmat &b, size_t n) {
+	t_dmat out;
+	for(size_t i = 0; i < n; ++i) {
+		for(size_t j = 0; j < n; ++j) {
+			out.m[i][j] = 0;
+			out.scale[i][j] = 0;
+			for(size_t k = 0; k < n; ++k) {
+				out.m[i][j] += a.m[k][j] * b.m[i][k];
+				out.scale[i][j] += a.scale[k][j] * b.scale[i][k];
+			}
+		}
+	}
+	return out;
+}
+
+/**
+ * Inverse by Gauss-Jordan elimination with partial pivoting. The scale of
+ * every element is the largest element of the inverse.
+ */
+t_dmat ref_inverse(const t_dmat &in, size_t n) {
+	double a[4][8];
+	for(size_t r = 0; r < n; ++r) {
+		for(size_t c = 0; c < n; ++c) {
+			a[r][c] = in.m[c][r];
+			a[r][n + c] = r == c;
+		}
+	}
+
+	for(size_t c = 0; c < n; ++c) {
+		size_t p = c;
+		for(size_t r = c + 1; r < n; ++r)
+			if(fabs(a[r][c]) > fabs(a[p][c]))
+				p = r;
+		for(size_t k = 0; k < 2 * n; ++k) {
+			double t = a[c][k];
+			a[c][k] = a[p][k];
+			a[p][k] = t;
+		}
+
+		double d = a[c][c];
+		for(size_t k = 0; k < 2 * n; ++k)
+			a[c][k] /= d;
+		for(size_t r = 0; r < n; ++r) {
+			double f = a[r][c];
+			if(r != c)
+				for(size_t k = 0; k < 2 * n; ++k)
+					a[r][k] -= f * a[c][k];
+		}
+	}
+
+	t_dmat out;
+	double largest = 0;
+	for(size_t r = 0; r < n; ++r) {
+		for(size_t c = 0; c < n; ++c) {
+			out.m[c][r] = a[r][n + c];
+			largest = fmax(largest, fabs(out.m[c][r]));
+		}
+	}
+	for(size_t r = 0; r < n; ++r)
+		for(size_t c = 0; c < n; ++c)
+			out.scale[c][r] = largest;
+	return out;
+}
+
+template<typename matT>
+void check_mat(const char *label, const char *name, double limit,
+		const matT &got, const t_dmat &ref) {
+	for(size_t i = 0; i < matT::rows; ++i)
+		for(size_t j = 0; j < matT::cols; ++j)
+			check(label, name, limit, got[i][j],
+					t_ref(ref.m[i][j], ref.scale[i][j]));
+}
+
+/**
+ * Random matrix kept well away from singular: random entries plus a
+ * dominant diagonal.
+ */
+template<typename matT>
+matT random_invertible() {
+	matT out;
+	for(size_t i = 0; i < matT::rows; ++i) {
+		for(size_t j = 0; j < matT::cols; ++j) {
+			float v = random_range(-1, 1);
+			out[i][j] = i == j ? v + (v < 0 ? -3 : 3) : v;
+		}
 	}
+	return out;
 }
 
-/* Print mat types */
-template<typename matTxT>
-void printm(const matTxT &in) {
-	printf("\n{\n");
-	for(size_t i = 0; i < matTxT::rows; ++i) {
-		printf("\t");
-		printv(in[i]);
+template<typename matT>
+void mat_test(const char *label) {
+	for(size_t it = 0; it < ITERATIONS; ++it) {
+		matT a = random_of<matT>();
+		matT b = random_of<matT>();
+		float s = random_value();
+
+		operator_test(label, a, b, s);
+
+		/* Default constructor is identity, T constructor a diagonal. */
+		matT id, diag(s);
+		for(size_t i = 0; i < matT::rows; ++i) {
+			for(size_t j = 0; j < matT::cols; ++j) {
+				check(label, "identity", id[i][j] == (i == j));
+				check(label, "diagonal", diag[i][j] == (i == j ? s : 0));
+			}
+		}
+	}
+}
+
+template<typename matT>
+void square_test(const char *label) {
+	const size_t n = matT::rows;
+
+	for(size_t it = 0; it < ITERATIONS; ++it) {
+		matT a = random_of<matT>();
+		matT b = random_of<matT>();
+		t_dmat da = to_dmat(a), db = to_dmat(b);
+
+		check_mat(label, "mul", n, matT::mul(a, b), ref_mul(da, db, n));
+
+		matT t = matT::transpose(a);
+		for(size_t i = 0; i < n; ++i)
+			for(size_t j = 0; j < n; ++j)
+				check(label, "transpose", t[i][j] == a[j][i]);
+	}
+}
+
+template<typename matT>
+void inverse_test(const char *label) {
+	const size_t n = matT::rows;
+
+	for(size_t it = 0; it < ITERATIONS; ++it) {
+		matT a = random_invertible<matT>();
+		check_mat(label, "inverse", 16, matT::inverse(a),
+				ref_inverse(to_dmat(a), n));
 	}
-	printf("}\n\n");
 }
 
 /**
- * Set up vector types in the format:
- *  vec2 a = { 1, 2 }
- *  vec2 b = { 3, 4 }
+ * Batched kernels, on a count that leaves the last batch partly filled.
+ */
+template<typename matT>
+void batch_test(const char *label) {
+	const size_t n = matT::rows;
+	const size_t count = 3 * BATCH_WIDTH + 5;
+	const size_t batches = (count + BATCH_WIDTH - 1) / BATCH_WIDTH;
+
+	matT a[count], b[count], out[count];
+	t_mat_batch<matT> ba[batches], bb[batches], bo[batches];
+
+	for(size_t it = 0; it < ITERATIONS / 10; ++it) {
+		for(size_t k = 0; k < count; ++k) {
+			a[k] = random_invertible<matT>();
+			b[k] = random_of<matT>();
+		}
+		batch_pack(a, count, ba);
+		batch_pack(b, count, bb);
+
+		batch_mul(ba, bb, bo, batches);
+		batch_unpack(bo, count, out);
+		for(size_t k = 0; k < count; ++k)
+			check_mat(label, "batch_mul", n, out[k],
+					ref_mul(to_dmat(a[k]), to_dmat(b[k]), n));
+
+		batch_transpose(ba, bo, batches);
+		batch_unpack(bo, count, out);
+		for(size_t k = 0; k < count; ++k)
+			check(label, "batch_transpose", out[k] == matT::transpose(a[k]));
+
+		batch_inverse(ba, bo, batches);
+		batch_unpack(bo, count, out);
+		for(size_t k = 0; k < count; ++k)
+			check_mat(label, "batch_inverse", 16, out[k],
+					ref_inverse(to_dmat(a[k]), n));
+	}
+}
+
+/* Rotation of 'rad' radians about 'axis', in double. */
+t_dmat ref_rotation(double rad, const vec3 &axis) {
+	double l = sqrt(double(axis.x) * axis.x + double(axis.y) * axis.y +
+			double(axis.z) * axis.z);
+	double a[] = { axis.x / l, axis.y / l, axis.z / l };
+	double s = sin(rad), c = cos(rad);
+
+	t_dmat out;
+	for(size_t i = 0; i < 4; ++i) {
+		for(size_t j = 0; j < 4; ++j) {
+			out.m[i][j] = i == j;
+			out.scale[i][j] = 1;
+		}
+	}
+
+	for(size_t i = 0; i < 3; ++i) {
+		for(size_t j = 0; j < 3; ++j) {
+			/* Column i, row j: c I + (1 - c) a a^T + s [a]x */
+			double cross = 0;
+			if((i + 1) % 3 == j)
+				cross = a[3 - i - j];
+			else if((j + 1) % 3 == i)
+				cross = -a[3 - i - j];
+			out.m[i][j] = (i == j ? c : 0) + (1 - c) * a[i] * a[j] +
+				s * cross;
+		}
+	}
+	return out;
+}
+
+t_dmat ref_identity() {
+	return to_dmat(mat4());
+}
+
+void mat4_test() {
+	const char *label = "mat4";
+
+	for(size_t it = 0; it < ITERATIONS; ++it) {
+		mat4 m = random_of<mat4>();
+		vec3 v = random_of<vec3>();
+		vec4 p = random_of<vec4>();
+		t_dmat dm = to_dmat(m);
+
+		t_dmat tr = ref_identity();
+		for(size_t j = 0; j < 3; ++j) {
+			tr.m[3][j] = v[j];
+			tr.scale[3][j] = fabs(v[j]);
+		}
+		check_mat(label, "translate", 4, mat4::translate(m, v),
+				ref_mul(dm, tr, 4));
+
+		t_dmat sc = ref_identity();
+		for(size_t j = 0; j < 3; ++j) {
+			sc.m[j][j] = v[j];
+			sc.scale[j][j] = fabs(v[j]);
+		}
+		check_mat(label, "scale", 0.5, mat4::scale(m, v), ref_mul(dm, sc, 4));
+
+		t_sum tp[4];
+		for(size_t k = 0; k < 4; ++k)
+			for(size_t j = 0; j < 4; ++j)
+				tp[j].add(dm.m[k][j] * p[k]);
+		vec4 got = mat4::transform(m, p);
+		for(size_t j = 0; j < 4; ++j)
+			check(label, "transform", 4, got[j], tp[j]);
+
+		/*
+		 * Rotations of a few turns, through the float sin_cos. The reference
+		 * starts from the same float radians, as the rounding of the angle
+		 * is the caller's.
+		 */
+		float deg = random_range(-1000, 1000);
+		double rad = to_radians(deg);
+		vec3 axis = random_of<vec3>();
+		t_dmat rot = ref_rotation(rad, axis);
+		check_mat(label, "rotation", 6,
+				mat4::rotation(sin(rad), cos(rad), axis), rot);
+		check_mat(label, "rotate", 12, mat4::rotate(m, deg, axis),
+				ref_mul(dm, rot, 4));
+
+		mat4 bulk;
+		mat4::rotations(&deg, &axis, &bulk, 1);
+		check_mat(label, "rotations", 12, bulk, rot);
+
+		/* Projections */
+		float fov = random_range(10, 170);
+		float aspect = random_range(0.25f, 4);
+		float znear = random_range(0.01f, 10);
+		float zfar = znear + random_range(1, 1000);
+		double th = tan(to_radians(fov) / 2);
+
+		t_dmat pr = ref_identity();
+		pr.m[0][0] = 1 / (aspect * th);
+		pr.m[1][1] = 1 / th;
+		pr.m[2][2] = -(double(zfar) + znear) / (double(zfar) - znear);
+		pr.m[2][3] = -1;
+		pr.m[3][2] = -2.0 * zfar * znear / (double(zfar) - znear);
+		pr.m[3][3] = 0;
+		for(size_t i = 0; i < 4; ++i)
+			for(size_t j = 0; j < 4; ++j)
+				pr.scale[i][j] = fabs(pr.m[i][j]);
+		check_mat(label, "perspective", 8,
+				mat4::perspective(fov, aspect, znear, zfar), pr);
+
+		float l = random_value(), r = l + fabsf(random_value());
+		float bo = random_value(), to = bo + fabsf(random_value());
+		t_dmat ot = ref_identity();
+		ot.m[0][0] = 2 / (double(r) - l);
+		ot.m[1][1] = 2 / (double(to) - bo);
+		ot.m[2][2] = -2 / (double(zfar) - znear);
+		ot.m[3][0] = -(double(r) + l) / (double(r) - l);
+		ot.m[3][1] = -(double(to) + bo) / (double(to) - bo);
+		ot.m[3][2] = -(double(zfar) + znear) / (double(zfar) - znear);
+		for(size_t i = 0; i < 4; ++i)
+			for(size_t j = 0; j < 4; ++j)
+				ot.scale[i][j] = fabs(ot.m[i][j]);
+		ot.scale[3][0] = (fabs(r) + fabs(l)) / (double(r) - l);
+		ot.scale[3][1] = (fabs(to) + fabs(bo)) / (double(to) - bo);
+		check_mat(label, "ortho", 4,
+				mat4::ortho(l, r, bo, to, znear, zfar), ot);
+
+		/* look_at, from an eye that may sit at the origin */
+		vec3 eye = it % 10 ? random_of<vec3>() : vec3(0);
+		vec3 centre = random_of<vec3>();
+		vec3 up = random_of<vec3>();
+		double f[3], s[3], u[3], up_d[3], fl = 0, sl = 0;
+		for(size_t j = 0; j < 3; ++j) {
+			f[j] = double(centre[j]) - eye[j];
+			up_d[j] = up[j];
+			fl += f[j] * f[j];
+		}
+		for(size_t j = 0; j < 3; ++j) {
+			f[j] /= sqrt(fl);
+		}
+		for(size_t j = 0; j < 3; ++j) {
+			s[j] = f[(j + 1) % 3] * up_d[(j + 2) % 3] -
+				f[(j + 2) % 3] * up_d[(j + 1) % 3];
+			sl += s[j] * s[j];
+		}
+		for(size_t j = 0; j < 3; ++j)
+			s[j] /= sqrt(sl);
+		for(size_t j = 0; j < 3; ++j)
+			u[j] = s[(j + 1) % 3] * f[(j + 2) % 3] -
+				s[(j + 2) % 3] * f[(j + 1) % 3];
+
+		t_dmat la = ref_identity();
+		t_sum ts, tu, tf;
+		for(size_t j = 0; j < 3; ++j) {
+			la.m[j][0] = s[j];
+			la.m[j][1] = u[j];
+			la.m[j][2] = -f[j];
+			ts.add(-s[j] * eye[j]);
+			tu.add(-u[j] * eye[j]);
+			tf.add(f[j] * eye[j]);
+		}
+		la.m[3][0] = ts.value;
+		la.m[3][1] = tu.value;
+		la.m[3][2] = tf.value;
+		/*
+		 * The basis is only as accurate as the cross product of f and up
+		 * allows, so errors are measured against the size of the eye.
+		 */
+		double reach = fmax(fmax(ts.scale, tu.scale), fmax(tf.scale, 1));
+		for(size_t i = 0; i < 4; ++i)
+			for(size_t j = 0; j < 4; ++j)
+				la.scale[i][j] = i == 3 ? reach : 1;
+
+		double sin_fu = sqrt(sl / (up_d[0] * up_d[0] + up_d[1] * up_d[1] +
+					up_d[2] * up_d[2]));
+		if(sin_fu > 0.1)
+			check_mat(label, "look_at", 64, mat4::look_at(eye, centre, up),
+					la);
+	}
+}
+
+/**********************************
+ * Trigonometry
+ **********************************/
+
+void trig_test() {
+	const char *label = "trig";
+	const size_t count = 64;
+	float in[count], s[count], c[count];
+
+	for(size_t it = 0; it < ITERATIONS; ++it) {
+		/* Within the first octant there is no reduction. */
+		float x = random_range(-PI / 4, PI / 4);
+		float xs, xc;
+		sin_cos(x, xs, xc);
+		check(label, "sin", 2, xs, sin(double(x)));
+		check(label, "cos", 2, xc, cos(double(x)));
+		check(label, "tangent", 3, tangent(x), tan(double(x)));
+
+		/*
+		 * A few turns, with one large input per array for the libm path.
+		 * Past the first octant the error of the reduction is absolute, so
+		 * it is measured in ulps of 1, and for tangent of 1 + tan^2.
+		 */
+		for(size_t k = 0; k < count; ++k)
+			in[k] = random_range(-8 * PI, 8 * PI);
+		in[it % count] = random_range(-20000, 20000);
+
+		sin_cos(in, s, c, count);
+		for(size_t k = 0; k < count; ++k) {
+			double t = tan(double(in[k]));
+			float ss, cs;
+			sin_cos(in[k], ss, cs);
+			check(label, "sin turns", 1, ss, t_ref(sin(double(in[k])), 1));
+			check(label, "cos turns", 1, cs, t_ref(cos(double(in[k])), 1));
+			check(label, "tangent turns", 2, tangent(in[k]),
+					t_ref(t, 1 + t * t));
+			check(label, "sin_cos array", s[k] == ss && c[k] == cs);
+		}
+
+		vec4 v4(in[0], in[1], in[2], in[3]), s4, c4;
+		sin_cos(v4, s4, c4);
+		for(size_t k = 0; k < 4; ++k)
+			check(label, "sin_cos vec4", s4[k] == s[k] && c4[k] == c[k]);
+	}
+}
+
+/**********************************
+ * Bulk functions
  *
- * where the first value of 'b' follows the last value of 'a'.
+ * Each kernel against a scalar or brute force reference, with one thread, a
+ * few, and more than PARALLEL_MAX_THREADS.
+ **********************************/
+
+static const size_t thread_counts[] = { 1, 3, PARALLEL_MAX_THREADS + 36 };
+
+#define THREAD_COUNTS (sizeof(thread_counts) / sizeof(thread_counts[0]))
+
+/**
+ * Count, bounds, mean and covariance of 'st' against a two pass reference
+ * over 'pts'. Centring loses up to an ulp of each point, so mean and
+ * covariance errors are measured against the points' own size. Limits grow
+ * with the number of partial results merged.
  */
-template<typename vecT>
-void initialise_vecs(vecT &v1, vecT &v2) {
-	for(size_t i = 0; i < vecT::length; ++i)
-		v1[i] = i + 1;
-	for(size_t i = 0; i < vecT::length; ++i)
-		v2[i] = i + 1 + vecT::length;
+void check_stats(const char *label, const vec3 *pts, size_t n,
+		const t_vec3_stats<float> &st, double mean_limit, double cov_limit) {
+	double mean[3] = { 0, 0, 0 }, size[3] = { 0, 0, 0 };
+	vec3 lo = n ? pts[0] : vec3(), hi = lo;
+
+	for(size_t i = 0; i < n; ++i) {
+		for(size_t a = 0; a < 3; ++a) {
+			mean[a] += pts[i][a];
+			size[a] += fabs(pts[i][a]);
+			lo[a] = fminf(lo[a], pts[i][a]);
+			hi[a] = fmaxf(hi[a], pts[i][a]);
+		}
+	}
+
+	check(label, "stats count", st.count == n);
+	if(n == 0)
+		return;
+	check(label, "stats bounds", st.min == lo && st.max == hi);
+
+	for(size_t a = 0; a < 3; ++a) {
+		mean[a] /= n;
+		check(label, "stats mean", mean_limit, st.mean[a],
+				t_ref(mean[a], size[a] / n));
+	}
+
+	t_mat3x3<float> cov = st.covariance();
+	for(size_t a = 0; a < 3; ++a) {
+		for(size_t b = 0; b < 3; ++b) {
+			double value = 0, scale = 0;
+			for(size_t i = 0; i < n; ++i) {
+				double da = pts[i][a] - mean[a], db = pts[i][b] - mean[b];
+				value += da * db;
+				scale += fabs(da) * fabs(pts[i][b]) +
+					fabs(pts[i][a]) * fabs(db);
+			}
+			check(label, "stats covariance", cov_limit, cov[a][b],
+					t_ref(value / n, scale / n));
+		}
+	}
+}
+
+void reduce_test() {
+	const char *label = "reduce";
+	const size_t count = 1000;
+	static vec3 pts[count];
+
+	for(size_t it = 0; it < ITERATIONS / 100; ++it) {
+		/* Offset from the origin, so covariance must be centred. */
+		float offset = random_range(-64, 64);
+		for(size_t i = 0; i < count; ++i)
+			for(size_t a = 0; a < 3; ++a)
+				pts[i][a] = offset + random_range(-1, 1);
+
+		t_sum total[3];
+		vec3 lo = pts[0], hi = pts[0];
+		for(size_t i = 0; i < count; ++i) {
+			for(size_t a = 0; a < 3; ++a) {
+				total[a].add(pts[i][a]);
+				lo[a] = fminf(lo[a], pts[i][a]);
+				hi[a] = fmaxf(hi[a], pts[i][a]);
+			}
+		}
+
+		for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+			size_t threads = thread_counts[r];
+			vec3 l, h;
+			reduce_bounds(pts, count, l, h, threads);
+			check(label, "bounds", l == lo && h == hi);
+
+			/* Blocks are summed in order, then pairwise. */
+			vec3 s = reduce_sum(pts, count, threads);
+			vec3 m = reduce_mean(pts, count, threads);
+			for(size_t a = 0; a < 3; ++a) {
+				check(label, "sum", 8, s[a], total[a]);
+				check(label, "mean", 8, m[a], t_ref(total[a].value / count,
+							total[a].scale / count));
+			}
+
+			check_stats(label, pts, count,
+					reduce_statistics(pts, count, threads), 6, 2);
+		}
+
+		/* Uneven parts merge to the statistics of the whole. */
+		size_t split = random_bits() % count;
+		t_vec3_stats<float> st;
+		st.add(pts, split);
+		t_vec3_stats<float> rest;
+		rest.add(pts + split, count - split);
+		st.merge(rest);
+		check_stats(label, pts, count, st, 6, 2);
+	}
+}
+
+/* Rotation about a random axis followed by a translation. */
+mat4 random_rigid() {
+	mat4 m = mat4::rotate(mat4(), random_range(-180, 180), random_of<vec3>());
+	m[3] = vec4(random_range(-4, 4), random_range(-4, 4),
+			random_range(-4, 4), 1);
+	return m;
+}
+
+struct t_skin_vertex {
+	vec3 position;
+	vec3 normal;
+	vec4i bones;
+	vec4 weights;
+};
+
+void skin_test() {
+	const char *label = "skin";
+	const size_t bone_count = 6, count = 200;
+	static mat4 bones[bone_count];
+	static t_dual_quat<float> quats[bone_count];
+	static t_skin_vertex verts[count];
+	static vec3 pos[count], nrm[count], pos2[count], nrm2[count];
+	static vec3 soa_pos[count], soa_nrm[count];
+	static vec4i soa_bones[count];
+	static vec4 soa_weights[count];
+
+	for(size_t it = 0; it < ITERATIONS / 100; ++it) {
+		for(size_t b = 0; b < bone_count; ++b) {
+			bones[b] = random_rigid();
+			quats[b] = t_dual_quat<float>::from_mat(bones[b]);
+		}
+
+		/* Every 4th vertex follows a single bone. */
+		for(size_t i = 0; i < count; ++i) {
+			t_skin_vertex &v = verts[i];
+			float total = 0;
+			for(size_t k = 0; k < 4; ++k) {
+				v.bones[k] = static_cast<int>(random_bits() % bone_count);
+				v.weights[k] = i % 4 == 0 ? (k == 0) : random_range(0.1f, 1);
+				total += v.weights[k];
+			}
+			v.weights /= total;
+			v.position = vec3(random_range(-2, 2), random_range(-2, 2),
+					random_range(-2, 2));
+			v.normal = vec3::normalise(random_of<vec3>());
+
+			soa_pos[i] = v.position;
+			soa_nrm[i] = v.normal;
+			soa_bones[i] = v.bones;
+			soa_weights[i] = v.weights;
+		}
+
+		t_skin_stream<float> packed = t_skin_stream<float>::interleaved(
+				verts, &t_skin_vertex::position, &t_skin_vertex::normal,
+				&t_skin_vertex::bones, &t_skin_vertex::weights);
+
+		for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+			size_t threads = thread_counts[r];
+
+			/* Linear blend, against the weighted sum of bone transforms */
+			skin_linear(bones, packed, pos, nrm, count, threads);
+			for(size_t i = 0; i < count; ++i) {
+				const t_skin_vertex &v = verts[i];
+				double p[3] = {}, ps[3] = {}, n[3] = {}, ns[3] = {};
+				for(size_t k = 0; k < 4; ++k) {
+					const mat4 &m = bones[v.bones[k]];
+					double w = v.weights[k];
+					for(size_t row = 0; row < 3; ++row) {
+						p[row] += w * m[3][row];
+						ps[row] += w * fabs(m[3][row]);
+						for(size_t c = 0; c < 3; ++c) {
+							p[row] += w * m[c][row] * v.position[c];
+							ps[row] += w * fabs(m[c][row] * v.position[c]);
+							n[row] += w * m[c][row] * v.normal[c];
+							ns[row] += w * fabs(m[c][row] * v.normal[c]);
+						}
+					}
+				}
+				double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				for(size_t row = 0; row < 3; ++row) {
+					check(label, "linear position", 4, pos[i][row],
+							t_ref(p[row], ps[row]));
+					check(label, "linear normal", 8, nrm[i][row],
+							t_ref(n[row] / len, ns[row] / len));
+				}
+			}
+
+			/*
+			 * Dual quaternions: single bone vertices against the bone's own
+			 * matrix, and all against the blend evaluated in double.
+			 */
+			skin_dual_quat(quats, packed, pos2, nrm2, count, threads);
+			for(size_t i = 0; i < count; ++i) {
+				const t_skin_vertex &v = verts[i];
+				const t_dual_quat<float> &q0 = quats[v.bones[0]];
+				double re[4] = {}, du[4] = {};
+				for(size_t k = 0; k < 4; ++k) {
+					const t_dual_quat<float> &q = quats[v.bones[k]];
+					double d = 0;
+					for(size_t c = 0; c < 4; ++c)
+						d += double(q0.real[c]) * q.real[c];
+					double w = d < 0 ? -v.weights[k] : v.weights[k];
+					for(size_t c = 0; c < 4; ++c) {
+						re[c] += w * q.real[c];
+						du[c] += w * q.dual[c];
+					}
+				}
+				double l = sqrt(re[0] * re[0] + re[1] * re[1] +
+						re[2] * re[2] + re[3] * re[3]);
+				for(size_t c = 0; c < 4; ++c) {
+					re[c] /= l;
+					du[c] /= l;
+				}
+
+				/* p + 2 r x (r x p + w p) + t, for the position and normal */
+				double t[3], rp[3], rn[3], pos_ref[3], nrm_ref[3];
+				for(size_t c = 0; c < 3; ++c) {
+					size_t a = (c + 1) % 3, b = (c + 2) % 3;
+					t[c] = 2 * (du[c] * re[3] - re[c] * du[3] +
+							re[a] * du[b] - re[b] * du[a]);
+					rp[c] = re[a] * v.position[b] - re[b] * v.position[a] +
+						re[3] * v.position[c];
+					rn[c] = re[a] * v.normal[b] - re[b] * v.normal[a] +
+						re[3] * v.normal[c];
+				}
+				for(size_t c = 0; c < 3; ++c) {
+					size_t a = (c + 1) % 3, b = (c + 2) % 3;
+					pos_ref[c] = v.position[c] + 2 * (re[a] * rp[b] -
+							re[b] * rp[a]) + t[c];
+					nrm_ref[c] = v.normal[c] + 2 * (re[a] * rn[b] -
+							re[b] * rn[a]);
+				}
+
+				/*
+				 * The rotation's terms stay within about 4 |p| and the
+				 * translation adds its own size; unit normals stay within 4.
+				 */
+				double reach = 1 + 4 * vec3::magnitude(v.position) +
+					fabs(t[0]) + fabs(t[1]) + fabs(t[2]);
+				for(size_t c = 0; c < 3; ++c) {
+					check(label, "dual_quat position", 4, pos2[i][c],
+							t_ref(pos_ref[c], reach));
+					check(label, "dual_quat normal", 3, nrm2[i][c],
+							t_ref(nrm_ref[c], 4));
+				}
+
+				if(i % 4 == 0) {
+					const mat4 &m = bones[v.bones[0]];
+					vec4 p(v.position.x, v.position.y, v.position.z, 1);
+					for(size_t c = 0; c < 3; ++c) {
+						t_sum s;
+						for(size_t k = 0; k < 4; ++k)
+							s.add(double(m[k][c]) * p[k]);
+						check(label, "dual_quat rigid", 4, pos2[i][c],
+								t_ref(s.value, reach));
+					}
+				}
+			}
+		}
+
+		/* Separate arrays give the same results as the interleaved ones. */
+		skin_linear(bones, t_skin_stream<float>::soa(soa_pos, soa_nrm,
+					soa_bones, soa_weights), pos2, nrm2, count);
+		check(label, "soa linear", memcmp(pos, pos2, sizeof(pos)) == 0 &&
+				memcmp(nrm, nrm2, sizeof(nrm)) == 0);
+	}
 }
 
 /**
- * Set up mat types in the same format as vector types.
+ * x solving a x = b, by Gaussian elimination with partial pivoting in
+ * double, and the determinant of a.
  */
-template<typename matTxT>
-void initialise_mats(matTxT &m1, matTxT &m2) {
-	for(size_t i = 0; i < matTxT::rows; ++i)
-		for(size_t j = 0; j < matTxT::cols; ++j)
-			m1[i][j] = i * matTxT::rows + j + 1;
+template<typename matT>
+double ref_solve(const matT &in, const typename matT::col_type &b,
+		double *x) {
+	const size_t n = matT::rows;
+	double a[8][9];
+	double det = 1;
 
-	for(size_t i = 0; i < matTxT::rows; ++i)
-		for(size_t j = 0; j < matTxT::cols; ++j)
-			m2[i][j] = (matTxT::rows + matTxT::cols) + i * matTxT::rows + j + 1;
+	for(size_t r = 0; r < n; ++r) {
+		for(size_t c = 0; c < n; ++c)
+			a[r][c] = in[c][r];
+		a[r][n] = b[r];
+	}
+
+	for(size_t c = 0; c < n; ++c) {
+		size_t p = c;
+		for(size_t r = c + 1; r < n; ++r)
+			if(fabs(a[r][c]) > fabs(a[p][c]))
+				p = r;
+		if(p != c) {
+			for(size_t k = 0; k <= n; ++k) {
+				double t = a[c][k];
+				a[c][k] = a[p][k];
+				a[p][k] = t;
+			}
+			det = -det;
+		}
+
+		det *= a[c][c];
+		for(size_t r = c + 1; r < n; ++r) {
+			double f = a[r][c] / a[c][c];
+			for(size_t k = c; k <= n; ++k)
+				a[r][k] -= f * a[c][k];
+		}
+	}
+
+	for(size_t r = n; r-- > 0;) {
+		double s = a[r][n];
+		for(size_t c = r + 1; c < n; ++c)
+			s -= a[r][c] * x[c];
+		x[r] = s / a[r][r];
+	}
+	return det;
 }
 
-template<typename vecT>
-void vec_test(const char *label) {
-	printf("\n*****************\n");
-	printf("**** %s", label);
-	printf("\n*****************\n");
-	vecT a, b;
-	initialise_vecs(a, b);
-	operator_test<vecT>(a, b, &printv);
+/**
+ * LU and Cholesky solves, with errors measured against the largest element
+ * of the solution as for inverse().
+ */
+template<typename matT>
+void solve_test(const char *label) {
+	typedef typename matT::col_type vecT;
+	const size_t n = matT::rows;
+
+	for(size_t it = 0; it < ITERATIONS; ++it) {
+		matT a = random_invertible<matT>();
+		vecT b = random_of<vecT>();
+		double x[8], largest = 0;
+		double det = ref_solve(a, b, x);
+		for(size_t i = 0; i < n; ++i)
+			largest = fmax(largest, fabs(x[i]));
 
-	printf("a:\t\t"); printv(a);
-	printf("b:\t\t"); printv(b);
-	printf("a/b dot:\t"); printf("%f\n", vecT::dot(a, b));
-	printf("a magnitude:\t"); printf("%f\n", vecT::magnitude(a));
-	printf("a normalise:\t"); printv(vecT::normalise(a));
+		vecT got;
+		check(label, "lu_solve ok", lu_solve(a, b, got));
+		for(size_t i = 0; i < n; ++i)
+			check(label, "lu_solve", 8, got[i], t_ref(x[i], largest));
+		check(label, "determinant", 2 * n, t_lu<matT>(a).determinant(), det);
+
+		/* Symmetric with a diagonal dominant enough to be positive definite */
+		matT s;
+		for(size_t i = 0; i < n; ++i) {
+			s[i][i] = n + random_range(0, 1);
+			for(size_t j = 0; j < i; ++j)
+				s[i][j] = s[j][i] = random_range(-1, 1);
+		}
+		ref_solve(s, b, x);
+		largest = 0;
+		for(size_t i = 0; i < n; ++i)
+			largest = fmax(largest, fabs(x[i]));
+		check(label, "cholesky_solve ok", cholesky_solve(s, b, got));
+		for(size_t i = 0; i < n; ++i)
+			check(label, "cholesky_solve", 8, got[i], t_ref(x[i], largest));
+
+		/* Rejections: a zero column, and a negative diagonal. */
+		a[random_bits() % n] = vecT(0);
+		s[0][0] = -1;
+		check(label, "singular", !lu_solve(a, b, got) &&
+				t_lu<matT>(a).determinant() == 0 &&
+				!cholesky_solve(s, b, got));
+	}
 }
 
-template<typename matTxT>
-void mat_test(const char *label) {
-	printf("\n*****************\n");
-	printf("**** %s", label);
-	printf("\n*****************\n");
-	matTxT a, b;
-	initialise_mats(a, b);
-	operator_test<matTxT>(a, b, &printm);
+/**
+ * spline_eval over SoA curves, on a count leaving a partial block, and
+ * spline_sample over one piecewise curve with parameters past both ends.
+ */
+template<typename basis>
+void spline_eval_test(const char *name) {
+	const char *label = "spline";
+	const size_t count = 3 * SPLINE_BLOCK + 5;
+	static float control[4][3][count], t[count], out[3][count];
+	t_spline_soa<float, 3> in;
+	float *outs[] = { out[0], out[1], out[2] };
+
+	for(size_t k = 0; k < 4; ++k)
+		for(size_t c = 0; c < 3; ++c)
+			in.control[k][c] = control[k][c];
+
+	for(size_t it = 0; it < ITERATIONS / 200; ++it) {
+		for(size_t i = 0; i < count; ++i) {
+			t[i] = random_range(0, 1);
+			for(size_t k = 0; k < 4; ++k)
+				for(size_t c = 0; c < 3; ++c)
+					control[k][c][i] = random_value();
+		}
+
+		for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+			spline_eval<basis>(in, t, outs, count, thread_counts[r]);
+			for(size_t i = 0; i < count; ++i) {
+				double w[4], ws[4];
+				ref_weights(basis(), t[i], w, ws);
+				for(size_t c = 0; c < 3; ++c) {
+					double v = 0, s = 0;
+					for(size_t k = 0; k < 4; ++k) {
+						v += w[k] * control[k][c][i];
+						s += ws[k] * fabs(control[k][c][i]);
+					}
+					check(label, name, 8, out[c][i], t_ref(v, s));
+				}
+			}
+		}
+	}
+}
+
+template<typename basis>
+void spline_sample_test(const char *name) {
+	const char *label = "spline";
+	const size_t n = 13, count = 100;
+	const size_t segments = (n - 4) / basis::step + 1;
+	vec3 points[n], out[count];
+	float t[count];
+
+	for(size_t it = 0; it < ITERATIONS / 100; ++it) {
+		for(size_t i = 0; i < n; ++i)
+			points[i] = random_of<vec3>();
+		for(size_t i = 0; i < count; ++i)
+			t[i] = random_range(-0.5f, segments + 0.5f);
+		/* Non-finite parameters clamp as fminf/fmaxf do, NaN to 0. */
+		t[it % count] = NAN;
+		t[(it + 1) % count] = INFINITY;
+		t[(it + 2) % count] = -INFINITY;
+
+		for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+			spline_sample<basis>(points, n, t, out, count, thread_counts[r]);
+			for(size_t i = 0; i < count; ++i) {
+				float u = fminf(fmaxf(t[i], 0), float(segments));
+				size_t seg = static_cast<size_t>(u);
+				seg = seg == segments ? seg - 1 : seg;
+				double w[4], ws[4];
+				ref_weights(basis(), u - float(seg), w, ws);
+				check_each(label, name, 8, out[i], [&](size_t c) {
+					return blend_ref(points + seg * basis::step, w, ws, c);
+				});
+			}
+		}
+	}
+}
+
+void spline_test() {
+	spline_eval_test<spline_hermite>("eval hermite");
+	spline_eval_test<spline_catmull_rom>("eval catmull_rom");
+	spline_eval_test<spline_bezier>("eval bezier");
+	spline_eval_test<spline_bspline>("eval bspline");
+	spline_sample_test<spline_hermite>("sample hermite");
+	spline_sample_test<spline_catmull_rom>("sample catmull_rom");
+	spline_sample_test<spline_bezier>("sample bezier");
+	spline_sample_test<spline_bspline>("sample bspline");
+}
+
+/**
+ * Positions far from the origin with the eye among them. The double paths
+ * must round once, and the split float path stay within an ulp of the
+ * parts it adds.
+ */
+void rte_test() {
+	const char *label = "rte";
+	const size_t count = 200;
+	static vec3d pos[count];
+	static vec3 hi[count], lo[count], out[count], split[count];
+	static t_mat4x4<double> models[count];
+	static mat4 model_out[count];
 
+	for(size_t it = 0; it < ITERATIONS / 100; ++it) {
+		vec3d eye;
+		for(size_t a = 0; a < 3; ++a)
+			eye[a] = ldexp(random_range(-1, 1), 24) + random_range(0, 1);
+
+		for(size_t i = 0; i < count; ++i) {
+			double reach = ldexp(1.0, static_cast<int>(random_bits() % 12));
+			for(size_t a = 0; a < 3; ++a)
+				pos[i][a] = eye[a] + reach * random_range(-1, 1) +
+					random_range(0, 1) * 1e-3;
+			models[i] = t_mat4x4<double>(0);
+			for(size_t c = 0; c < 4; ++c)
+				for(size_t r = 0; r < 4; ++r)
+					models[i][c][r] = c == 3 && r < 3 ? pos[i][r] :
+						random_range(-1, 1);
+			models[i][3][3] = 1;
+		}
+
+		for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+			size_t threads = thread_counts[r];
+			split_positions(pos, hi, lo, count, threads);
+			relative_to_eye(pos, eye, out, count, threads);
+			relative_to_eye(hi, lo, eye, split, count, threads);
+			relative_to_eye(models, eye, model_out, count, threads);
+
+			vec3 eye_hi, eye_lo;
+			split_positions(&eye, &eye_hi, &eye_lo, 1);
+
+			for(size_t i = 0; i < count; ++i) {
+				bool exact = true, model = true;
+				for(size_t a = 0; a < 3; ++a) {
+					float h = static_cast<float>(pos[i][a]);
+					exact = exact && hi[i][a] == h &&
+						lo[i][a] == static_cast<float>(pos[i][a] - h) &&
+						out[i][a] == static_cast<float>(pos[i][a] - eye[a]);
+
+					double d = pos[i][a] - eye[a];
+					check(label, "split relative_to_eye", 1, split[i][a],
+							t_ref(d, fabs(d) + fabs(lo[i][a]) +
+								fabs(eye_lo[a])));
+				}
+				for(size_t c = 0; c < 4; ++c) {
+					for(size_t row = 0; row < 4; ++row) {
+						double v = models[i][c][row];
+						if(c == 3 && row < 3)
+							v -= eye[row];
+						model = model &&
+							model_out[i][c][row] == static_cast<float>(v);
+					}
+				}
+				check(label, "split_positions", exact);
+				check(label, "model relative_to_eye", model);
+			}
+		}
+
+		mat4 v = view_rotation(models[0]);
+		bool rot = true;
+		for(size_t c = 0; c < 4; ++c)
+			for(size_t row = 0; row < 4; ++row)
+				rot = rot && v[c][row] == (c < 3 && row < 3 ?
+						static_cast<float>(models[0][c][row]) : c == row);
+		check(label, "view_rotation", rot);
+	}
+}
+
+/**
+ * A jittered height field of w x h vertices in row order, as exporters
+ * write them, plus a degenerate triangle and two unused vertices. The jitter
+ * keeps corner angles away from 0 and 180 degrees, where the tangent
+ * weights' acos() is ill-conditioned.
+ */
+struct t_test_mesh {
+	static const size_t w = 12, h = 10;
+	static const size_t vertex_count = w * h + 2;
+	static const size_t tri_count = 2 * (w - 1) * (h - 1) + 1;
+	vec3 pos[vertex_count];
+	vec2 uv[vertex_count];
+	vec3i tris[tri_count];
+
+	t_test_mesh() {
+		for(size_t y = 0; y < h; ++y) {
+			for(size_t x = 0; x < w; ++x) {
+				size_t v = y * w + x;
+				pos[v] = vec3(x + random_range(-0.2f, 0.2f),
+						y + random_range(-0.2f, 0.2f),
+						random_range(-0.5f, 0.5f));
+				uv[v] = vec2(x * 0.1f + random_range(-0.02f, 0.02f),
+						y * 0.1f + random_range(-0.02f, 0.02f));
+			}
+		}
+		pos[w * h] = pos[w * h + 1] = vec3(0);
+		uv[w * h] = uv[w * h + 1] = vec2(0);
+
+		size_t t = 0;
+		for(size_t y = 0; y + 1 < h; ++y) {
+			for(size_t x = 0; x + 1 < w; ++x) {
+				int v = static_cast<int>(y * w + x), r = static_cast<int>(w);
+				tris[t++] = vec3i(v, v + 1, v + r + 1);
+				tris[t++] = vec3i(v, v + r + 1, v + r);
+			}
+		}
+		tris[t] = vec3i(0, 0, 1);
+	}
+};
+
+/* Double vector helpers for the mesh references. */
+struct t_d3 {
+	double v[3];
+};
+
+t_d3 d3(const vec3 &in) {
+	t_d3 out = {{ in.x, in.y, in.z }};
+	return out;
+}
+
+t_d3 d3_sub(const t_d3 &a, const t_d3 &b) {
+	t_d3 out = {{ a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2] }};
+	return out;
+}
+
+t_d3 d3_cross(const t_d3 &a, const t_d3 &b) {
+	t_d3 out;
+	for(size_t c = 0; c < 3; ++c)
+		out.v[c] = a.v[(c + 1) % 3] * b.v[(c + 2) % 3] -
+			a.v[(c + 2) % 3] * b.v[(c + 1) % 3];
+	return out;
+}
+
+double d3_dot(const t_d3 &a, const t_d3 &b) {
+	return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+}
+
+t_d3 d3_scale(const t_d3 &a, double s) {
+	t_d3 out = {{ a.v[0] * s, a.v[1] * s, a.v[2] * s }};
+	return out;
+}
+
+t_d3 d3_normalise(const t_d3 &a) {
+	double l = sqrt(d3_dot(a, a));
+	return l > 0 ? d3_scale(a, 1 / l) : a;
+}
+
+/* 'in' projected onto the plane normal to 'n' and normalised. */
+t_d3 d3_tangent_plane(const t_d3 &n, const t_d3 &in) {
+	return d3_normalise(d3_sub(in, d3_scale(n, d3_dot(n, in))));
+}
+
+void mesh_test() {
+	const char *label = "mesh";
+	const size_t vn = t_test_mesh::vertex_count, tn = t_test_mesh::tri_count;
+	static vec3 faces[tn], normals[vn];
+	static vec4 tangents[vn];
+
+	for(size_t it = 0; it < ITERATIONS / 100; ++it) {
+		t_test_mesh m;
+
+		/*
+		 * Edges are taken in float, so errors are measured against the
+		 * positions they come from, relative to the normal's length.
+		 */
+		t_d3 n_ref[tn], v_sum[vn] = {};
+		double n_scale[tn], v_scale[vn] = {};
+		for(size_t t = 0; t < tn; ++t) {
+			const vec3i &tri = m.tris[t];
+			t_d3 p0 = d3(m.pos[tri.x]);
+			t_d3 e1 = d3_sub(d3(m.pos[tri.y]), p0);
+			t_d3 e2 = d3_sub(d3(m.pos[tri.z]), p0);
+			t_d3 n = d3_cross(e1, e2);
+			double size = 0;
+			for(size_t c = 0; c < 3; ++c)
+				size = fmax(size, vec3::magnitude(m.pos[tri[c]]));
+			double err = 2 * size * (sqrt(d3_dot(e1, e1)) +
+					sqrt(d3_dot(e2, e2)));
+
+			n_ref[t] = d3_normalise(n);
+			n_scale[t] = err / fmax(sqrt(d3_dot(n, n)), 1e-30);
+			for(size_t c = 0; c < 3; ++c) {
+				size_t v = static_cast<size_t>(tri[c]);
+				for(size_t a = 0; a < 3; ++a)
+					v_sum[v].v[a] += n.v[a];
+				v_scale[v] += sqrt(d3_dot(n, n)) + err;
+			}
+		}
+
+		for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+			size_t threads = thread_counts[r];
+
+			face_normals(m.pos, m.tris, faces, tn, threads);
+			for(size_t t = 0; t + 1 < tn; ++t)
+				for(size_t c = 0; c < 3; ++c)
+					check(label, "face_normals", 1, faces[t][c],
+							t_ref(n_ref[t].v[c], n_scale[t]));
+			check(label, "face_normals degenerate", faces[tn - 1] == vec3(0));
+
+			vertex_normals(m.pos, vn, m.tris, tn, normals, threads);
+			for(size_t v = 0; v < vn; ++v) {
+				double l = sqrt(d3_dot(v_sum[v], v_sum[v]));
+				if(l == 0) {
+					check(label, "vertex_normals unused",
+							normals[v] == vec3(0));
+					continue;
+				}
+				for(size_t c = 0; c < 3; ++c)
+					check(label, "vertex_normals", 1, normals[v][c],
+							t_ref(v_sum[v].v[c] / l, v_scale[v] / l));
+			}
+		}
+
+		/*
+		 * Tangents against the same construction in double, from the float
+		 * normals: per corner, face tangent and bitangent projected onto
+		 * the vertex plane and weighted by the projected corner angle.
+		 */
+		t_d3 t_sum_ref[vn] = {}, b_sum_ref[vn] = {};
+		double reach = 0;
+		for(size_t v = 0; v < vn; ++v)
+			reach = fmax(reach, vec3::magnitude(m.pos[v]));
+
+		for(size_t t = 0; t < tn; ++t) {
+			const vec3i &tri = m.tris[t];
+			t_d3 p[3], e1, e2;
+			for(size_t c = 0; c < 3; ++c)
+				p[c] = d3(m.pos[tri[c]]);
+			e1 = d3_sub(p[1], p[0]);
+			e2 = d3_sub(p[2], p[0]);
+			double du1 = double(m.uv[tri.y].x) - m.uv[tri.x].x;
+			double dv1 = double(m.uv[tri.y].y) - m.uv[tri.x].y;
+			double du2 = double(m.uv[tri.z].x) - m.uv[tri.x].x;
+			double dv2 = double(m.uv[tri.z].y) - m.uv[tri.x].y;
+			double area = du1 * dv2 - du2 * dv1;
+			if(area == 0)
+				continue;
+			double s = area < 0 ? -1 : 1;
+			t_d3 ft = d3_scale(d3_sub(d3_scale(e1, dv2), d3_scale(e2, dv1)), s);
+			t_d3 fb = d3_scale(d3_sub(d3_scale(e2, du1), d3_scale(e1, du2)), s);
+
+			for(size_t c = 0; c < 3; ++c) {
+				size_t v = static_cast<size_t>(tri[c]);
+				t_d3 n = d3(normals[v]);
+				t_d3 a = d3_tangent_plane(n, d3_sub(p[(c + 1) % 3], p[c]));
+				t_d3 d = d3_tangent_plane(n, d3_sub(p[(c + 2) % 3], p[c]));
+				double angle = acos(fmax(-1, fmin(1, d3_dot(a, d))));
+				t_d3 ct = d3_tangent_plane(n, ft);
+				t_d3 cb = d3_tangent_plane(n, fb);
+				for(size_t k = 0; k < 3; ++k) {
+					t_sum_ref[v].v[k] += ct.v[k] * angle;
+					b_sum_ref[v].v[k] += cb.v[k] * angle;
+				}
+			}
+		}
+
+		for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+			vertex_tangents(m.pos, normals, m.uv, vn, m.tris, tn, tangents,
+					thread_counts[r]);
+			for(size_t v = 0; v < vn; ++v) {
+				t_d3 n = d3(normals[v]);
+				t_d3 tv = d3_sub(t_sum_ref[v],
+						d3_scale(n, d3_dot(n, t_sum_ref[v])));
+				double l = sqrt(d3_dot(tv, tv));
+				if(l == 0) {
+					check(label, "vertex_tangents unused",
+							tangents[v] == vec4(0, 0, 0, 1));
+					continue;
+				}
+
+				/* Positions round to an ulp of the mesh's extent. */
+				for(size_t c = 0; c < 3; ++c)
+					check(label, "vertex_tangents", 8, tangents[v][c],
+							t_ref(tv.v[c] / l, reach / l));
+
+				double side = d3_dot(d3_cross(n, tv), b_sum_ref[v]);
+				if(fabs(side) > 1e-3 * l)
+					check(label, "vertex_tangents sign",
+							tangents[v].w == (side < 0 ? -1 : 1));
+			}
+		}
+	}
+}
+
+/**
+ * Grid queries against brute force over the same float distances: radius
+ * results as per query counts and index sums, and k-nearest distances in
+ * order. Some queries fall outside the points' bounds, and repeated points
+ * give ties.
+ */
+template<typename indexT>
+void spatial_test(const char *label) {
+	const size_t count = 2000, queries = 64, k = 8;
+	static vec3 pts[count], q[queries];
+	static uint32_t found_index[queries * k];
+	static float found_d2[queries * k];
+	static size_t found[queries];
+	static size_t hits[queries];
+	static uint64_t index_sum[queries];
+	indexT index;
+
+	for(size_t it = 0; it < ITERATIONS / 250; ++it) {
+		float extent = random_range(1, 100);
+		for(size_t i = 0; i < count; ++i) {
+			if(i % 50 == 1)
+				pts[i] = pts[i - 1];
+			else
+				for(size_t a = 0; a < 3; ++a)
+					pts[i][a] = random_range(-extent, extent);
+		}
+		for(size_t i = 0; i < queries; ++i)
+			for(size_t a = 0; a < 3; ++a)
+				q[i][a] = random_range(-1.5f * extent, 1.5f * extent);
+		float cell = extent * random_range(0.02f, 0.2f);
+		float radius = extent * random_range(0.05f, 0.3f);
+
+		for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+			size_t threads = thread_counts[r];
+			index.build(pts, count, cell, threads);
+
+			index.nearest(q, queries, k, found_index, found_d2, found,
+					threads);
+			memset(hits, 0, sizeof(hits));
+			memset(index_sum, 0, sizeof(index_sum));
+			index.radius(q, queries, radius,
+					[&](size_t, size_t qi, uint32_t i, float) {
+				++hits[qi];
+				index_sum[qi] += i;
+			}, threads);
+
+			for(size_t qi = 0; qi < queries; ++qi) {
+				float best[k];
+				size_t n = 0, in_radius = 0;
+				uint64_t sum_ref = 0;
+				for(size_t i = 0; i < count; ++i) {
+					float d2 = vec3::distance_squared(pts[i], q[qi]);
+					if(d2 <= radius * radius) {
+						++in_radius;
+						sum_ref += i;
+					}
+					if(n == k && d2 >= best[k - 1])
+						continue;
+					size_t j = n < k ? n++ : k - 1;
+					for(; j > 0 && best[j - 1] > d2; --j)
+						best[j] = best[j - 1];
+					best[j] = d2;
+				}
+
+				const uint32_t *fi = found_index + qi * k;
+				const float *fd = found_d2 + qi * k;
+				bool same = found[qi] == k;
+				for(size_t j = 0; same && j < k; ++j)
+					same = fd[j] == best[j] &&
+						vec3::distance_squared(pts[fi[j]], q[qi]) == fd[j];
+				check(label, "nearest", same);
+				check(label, "radius",
+						hits[qi] == in_radius && index_sum[qi] == sum_ref);
+			}
+		}
+	}
+
+	/* Fewer points than asked for, then none. */
+	index.build(pts, 3, 1.0f);
+	check(label, "nearest few", index.nearest(q[0], k, found_index,
+				found_d2) == 3);
+	index.build(pts, 0, 1.0f);
+	size_t none = 0;
+	index.radius(q[0], 1e30f, [&](uint32_t, float) { ++none; });
+	check(label, "empty", none == 0 &&
+			index.nearest(q[0], k, found_index, found_d2) == 0);
+}
+
+/**
+ * One writer publishing partial updates while readers take snapshots. Each
+ * element is a matrix filled with the frame that last wrote it, element 0
+ * always, so a snapshot names its frame and must match that frame's
+ * contents exactly, with no matrix torn.
+ */
+void store_test() {
+	const char *label = "store";
+	const size_t count = 40, frames = 1000, readers = 2;
+	typedef t_transform_store<mat4, readers> storeT;
+	static float frame_log[frames + 1][count];
+	storeT store(count, 7);
+	std::atomic<bool> done(false);
+	size_t snapshots[readers] = {}, torn[readers] = {}, order[readers] = {};
+
+	auto fill = [](mat4 &m, float v) {
+		for(size_t i = 0; i < 16; ++i)
+			component(m, i) = v;
+	};
+
+	mat4 *back = store.write();
+	for(size_t i = 0; i < count; ++i)
+		fill(back[i], 0);
+	store.mark(0, count);
+	store.publish();
+
+	std::thread pool[readers];
+	for(size_t r = 0; r < readers; ++r) {
+		pool[r] = std::thread([&, r]() {
+			float last = 0;
+			do {
+				t_transform_snapshot<storeT> snap(store);
+				float f = snap[0][0][0];
+				const float *expect = frame_log[static_cast<size_t>(f)];
+				for(size_t i = 0; i < count; ++i)
+					for(size_t c = 0; c < 16; ++c)
+						torn[r] += get(snap[i], c) != expect[i];
+				order[r] += f < last;
+				last = f;
+				++snapshots[r];
+			} while(!done.load());
+		});
+	}
+
+	float shadow[count] = {};
+	for(size_t f = 1; f <= frames; ++f) {
+		size_t first = 1 + random_bits() % (count - 1);
+		size_t n = random_bits() % (count - first + 1);
+
+		back = store.write();
+		fill(back[0], float(f));
+		for(size_t i = first; i < first + n; ++i)
+			fill(back[i], float(f));
+		store.mark(0, 1);
+		store.mark(first, n);
+
+		shadow[0] = float(f);
+		for(size_t i = first; i < first + n; ++i)
+			shadow[i] = float(f);
+		memcpy(frame_log[f], shadow, sizeof(shadow));
+		store.publish();
+
+		if(f % 32 == 0)
+			std::this_thread::yield();
+	}
+
+	done.store(true);
+	for(size_t r = 0; r < readers; ++r) {
+		pool[r].join();
+		check(label, "snapshot consistent", snapshots[r] > 0 && torn[r] == 0);
+		check(label, "snapshot order", order[r] == 0);
+	}
+
+	t_transform_snapshot<storeT> snap(store);
+	bool latest = true;
+	for(size_t i = 0; i < count; ++i)
+		for(size_t c = 0; c < 16; ++c)
+			latest = latest && get(snap[i], c) == shadow[i];
+	check(label, "latest", latest);
 }
 
-int main()
+/**
+ * A transform and filter streamed through files in chunks, against the
+ * same stage run over the whole array in memory. The input ends with a
+ * partial point, which is ignored. 1037 points are 17 chunks of 61.
+ */
+void stream_test() {
+	const char *label = "stream";
+	const size_t count = 1037;
+	static const size_t chunks[] = { 1, 100, STREAM_CHUNK };
+	static vec3 pts[count], ref[count], got[count + 1];
+
+	for(size_t it = 0; it < ITERATIONS / 500; ++it) {
+		for(size_t i = 0; i < count; ++i)
+			for(size_t a = 0; a < 3; ++a)
+				pts[i][a] = random_range(-10, 10);
+
+		auto stage = stream_chain(stream_transform(random_rigid()),
+				stream_filter<float>([](const vec3 &p) { return p.x > 0; }));
+		memcpy(ref, pts, sizeof(pts));
+		size_t kept = stage(ref, count);
+
+		FILE *in = tmpfile();
+		fwrite(pts, sizeof(vec3), count, in);
+		fwrite(pts, 5, 1, in);
+
+		for(size_t c = 0; c < 3; ++c) {
+			for(size_t r = 0; r < THREAD_COUNTS; ++r) {
+				FILE *out = tmpfile();
+				t_vec3_stats<float> st;
+				rewind(in);
+				bool ok = stream_points(in, out, stage, &st, chunks[c],
+						thread_counts[r]);
+
+				rewind(out);
+				size_t n = fread(got, sizeof(vec3), count + 1, out);
+				fclose(out);
+				check(label, "stream_points", ok && n == kept &&
+						memcmp(got, ref, kept * sizeof(vec3)) == 0);
+				check_stats(label, ref, kept, st, 16, 12);
+			}
+		}
+
+		/* A plain lambda stage and no statistics, over whole chunks. */
+		FILE *out = tmpfile();
+		rewind(in);
+		bool ok = stream_points(in, out, [](vec3 *, size_t n) {
+			return n;
+		}, 0, 61);
+		rewind(out);
+		size_t n = fread(got, sizeof(vec3), count + 1, out);
+		fclose(out);
+		check(label, "stream_points unstaged", ok && n == count &&
+				memcmp(got, pts, count * sizeof(vec3)) == 0);
+		fclose(in);
+	}
+}
+
+int main(int argc, char **argv)
 {
+	unsigned seed = argc > 1 ? static_cast<unsigned>(atoi(argv[1])) : 1;
+	rng_state = 0x9e3779b97f4a7c15ull ^ seed;
+	printf("seed %u\n\n", seed);
+
 	vec_test<vec2>("vec2");
 	vec_test<vec3>("vec3");
 	vec_test<vec4>("vec4");
+	vec_test<t_vecn<float, 6>>("vec6");
+	vec3_test();
 
 	mat_test<mat2>("mat2");
 	mat_test<mat2x3>("mat2x3");
@@ -204,20 +2017,31 @@ int main()
 	mat_test<mat4x2>("mat4x2");
 	mat_test<mat4x3>("mat4x3");
 	mat_test<mat4>("mat4");
+	mat_test<t_matn<float, 5, 6>>("mat5x6");
 
-	/**
-	 * Additional mat4 functions.
-	 */
-	{
-		vec3 eye = vec3(12, 8, 4);
-		vec3 centre;
-		vec3 up = vec3(0, 1, 0);
+	square_test<mat2>("mat2");
+	square_test<mat3>("mat3");
+	square_test<mat4>("mat4");
+	inverse_test<mat3>("mat3");
+	inverse_test<mat4>("mat4");
+	batch_test<mat3>("mat3");
+	batch_test<mat4>("mat4");
+	mat4_test();
 
-		mat4 m = mat4::look_at(eye, centre, up);
-		m = mat4::translate(m, vec3(2.5, 3.3, 4.4));
-		m = mat4::rotate(m, 3.f, vec3(0.2, 0.6, 0.8));
-		m = mat4::scale(m, vec3(0.2, 0.6, 0.8));
-	}
+	trig_test();
+
+	reduce_test();
+	skin_test();
+	solve_test<mat3>("mat3");
+	solve_test<mat4>("mat4");
+	solve_test<t_matn<float, 6, 6>>("mat6");
+	spline_test();
+	rte_test();
+	mesh_test();
+	spatial_test<t_spatial_grid<float>>("spatial grid");
+	spatial_test<t_spatial_morton<float>>("spatial morton");
+	store_test();
+	stream_test();
 
-	return 0;
+	return report() ? 1 : 0;
 }
@@ -2,7 +2,8 @@
 #define MAT_H
 
 /**
- * CRTP definitions of matrix classes, everything in between 2x2 to 4x4.
+ * CRTP definitions of matrix classes, everything in between 2x2 to 4x4, plus
+ * t_matn for larger shapes.
  *
  * Matrix types are composed of two vectors (rows and columns).
  * Default constructor and type T constructor provide an identity matrix.
@@ -11,12 +12,13 @@
  */
 
 #include "vec.h"
+#include "trig.h"
 
 #define PI 3.14159265358979323846
 
 template <typename T>
 static T to_radians(T in) {
-	return in * (PI / 180);
+	return in * static_cast<T>(PI / 180);
 }
 
 template<typename T, typename Row, typename Col, typename t_matxx>
@@ -24,36 +26,31 @@ struct t_mat {
 private:
 	Col data[Row::length];
 
-	t_matxx this_to_matxx() const {
-		t_matxx out;
-		for(size_t i = 0; i < rows; ++i)
-				out[i] = data[i];
-		return out;
+	T_VEC_INLINE t_matxx this_to_matxx() const {
+		return static_cast<const t_matxx&>(*this);
 	}
 
 public:
+	typedef T value_type;
+	typedef Col col_type;
 	static constexpr size_t rows = Row::length;
 	static constexpr size_t cols = Col::length;
 
-	t_mat() {
-		for(size_t i = 0; i < rows && i < cols; ++i)
-			data[i][i] = 1;
+	T_VEC_INLINE t_mat() {
+		T_VEC_EACH(i, rows, if(i < cols) data[i][i] = 1);
 	}
 
-	t_mat(const t_matxx &other) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] = other[i];
+	T_VEC_INLINE t_mat(const t_matxx &other) {
+		T_VEC_EACH(i, rows, data[i] = other[i]);
 	}
 
-	t_mat(T in) {
-		for(size_t i = 0; i < rows && i < cols; ++i)
-			data[i][i] = in;
+	T_VEC_INLINE t_mat(T in) {
+		T_VEC_EACH(i, rows, if(i < cols) data[i][i] = in);
 	}
 
 
-	t_matxx& operator=(const t_matxx &other) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] = other[i];
+	T_VEC_INLINE t_matxx& operator=(const t_matxx &other) {
+		T_VEC_EACH(i, rows, data[i] = other[i]);
 		return static_cast<t_matxx&>(*this);
 	}
 
@@ -61,11 +58,11 @@ public:
 	 * Access
 	 **********************************/
 
-	Col& operator[](size_t i) {
+	T_VEC_INLINE Col& operator[](size_t i) {
 		return data[i];
 	}
 
-	const Col& operator[](size_t i) const {
+	T_VEC_INLINE const Col& operator[](size_t i) const {
 		return data[i];
 	}
 
@@ -73,31 +70,27 @@ public:
 	 * Operator with mat
 	 **********************************/
 
-	t_matxx operator+(const t_matxx &other) const {
+	T_VEC_INLINE t_matxx operator+(const t_matxx &other) const {
 		t_matxx out = this_to_matxx();
-		for(size_t i = 0; i < rows; ++i)
-			out[i] += other[i];
+		T_VEC_EACH(i, rows, out[i] += other[i]);
 		return out;
 	}
 
-	t_matxx operator-(const t_matxx &other) const {
+	T_VEC_INLINE t_matxx operator-(const t_matxx &other) const {
 		t_matxx out = this_to_matxx();
-		for(size_t i = 0; i < rows; ++i)
-			out[i] -= other[i];
+		T_VEC_EACH(i, rows, out[i] -= other[i]);
 		return out;
 	}
 
-	t_matxx operator*(const t_matxx &other) const {
+	T_VEC_INLINE t_matxx operator*(const t_matxx &other) const {
 		t_matxx out = this_to_matxx();
-		for(size_t i = 0; i < rows; ++i)
-			out[i] *= other[i];
+		T_VEC_EACH(i, rows, out[i] *= other[i]);
 		return out;
 	}
 
-	t_matxx operator/(const t_matxx &other) const {
+	T_VEC_INLINE t_matxx operator/(const t_matxx &other) const {
 		t_matxx out = this_to_matxx();
-		for(size_t i = 0; i < rows; ++i)
-			out[i] /= other[i];
+		T_VEC_EACH(i, rows, out[i] /= other[i]);
 		return out;
 	}
 
@@ -105,27 +98,23 @@ public:
 	 * Shorthands with mat
 	 ***********************************/
 
-	t_matxx& operator+=(const t_matxx &other) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] += other[i];
+	T_VEC_INLINE t_matxx& operator+=(const t_matxx &other) {
+		T_VEC_EACH(i, rows, data[i] += other[i]);
 		return static_cast<t_matxx&>(*this);
 	}
 
-	t_matxx& operator-=(const t_matxx &other) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] -= other[i];
+	T_VEC_INLINE t_matxx& operator-=(const t_matxx &other) {
+		T_VEC_EACH(i, rows, data[i] -= other[i]);
 		return static_cast<t_matxx&>(*this);
 	}
 
-	t_matxx& operator*=(const t_matxx &other) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] *= other[i];
+	T_VEC_INLINE t_matxx& operator*=(const t_matxx &other) {
+		T_VEC_EACH(i, rows, data[i] *= other[i]);
 		return static_cast<t_matxx&>(*this);
 	}
 
-	t_matxx& operator/=(const t_matxx &other) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] /= other[i];
+	T_VEC_INLINE t_matxx& operator/=(const t_matxx &other) {
+		T_VEC_EACH(i, rows, data[i] /= other[i]);
 		return static_cast<t_matxx&>(*this);
 	}
 
@@ -133,32 +122,28 @@ public:
 	 * Operators with type
 	 **********************************/
 
-	t_matxx operator+(T in) const {
+	T_VEC_INLINE t_matxx operator+(T in) const {
 		t_matxx out = this_to_matxx();
-		for(size_t i = 0; i < rows; ++i)
-			out[i] += in;
+		T_VEC_EACH(i, rows, out[i] += in);
 		return out;
 	}
 
-	t_matxx operator-(T in) const {
+	T_VEC_INLINE t_matxx operator-(T in) const {
 		t_matxx out = this_to_matxx();
-		for(size_t i = 0; i < rows; ++i)
-			out[i] -= in;
+		T_VEC_EACH(i, rows, out[i] -= in);
 		return out;
 	}
 
 
-	t_matxx operator*(T in) const {
+	T_VEC_INLINE t_matxx operator*(T in) const {
 		t_matxx out = this_to_matxx();
-		for(size_t i = 0; i < rows; ++i)
-			out[i] *= in;
+		T_VEC_EACH(i, rows, out[i] *= in);
 		return out;
 	}
 
-	t_matxx operator/(T in) const {
+	T_VEC_INLINE t_matxx operator/(T in) const {
 		t_matxx out = this_to_matxx();
-		for(size_t i = 0; i < rows; ++i)
-			out[i] /= in;
+		T_VEC_EACH(i, rows, out[i] /= in);
 		return out;
 	}
 
@@ -166,27 +151,23 @@ public:
 	 * Shorthands with type
 	 **********************************/
 
-	t_matxx& operator+=(T in) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] += in;
+	T_VEC_INLINE t_matxx& operator+=(T in) {
+		T_VEC_EACH(i, rows, data[i] += in);
 		return static_cast<t_matxx&>(*this);
 	}
 
-	t_matxx& operator-=(T in) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] -= in;
+	T_VEC_INLINE t_matxx& operator-=(T in) {
+		T_VEC_EACH(i, rows, data[i] -= in);
 		return static_cast<t_matxx&>(*this);
 	}
 
-	t_matxx& operator*=(T in) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] *= in;
+	T_VEC_INLINE t_matxx& operator*=(T in) {
+		T_VEC_EACH(i, rows, data[i] *= in);
 		return static_cast<t_matxx&>(*this);
 	}
 
-	t_matxx& operator/=(T in) {
-		for(size_t i = 0; i < rows; ++i)
-			data[i] /= in;
+	T_VEC_INLINE t_matxx& operator/=(T in) {
+		T_VEC_EACH(i, rows, data[i] /= in);
 		return static_cast<t_matxx&>(*this);
 	}
 
@@ -194,10 +175,9 @@ public:
 	 * Negation
 	 **********************************/
 
-	t_matxx operator-() const {
+	T_VEC_INLINE t_matxx operator-() const {
 		t_matxx out;
-		for(size_t i = 0; i < rows; ++i)
-			out[i] = -data[i];
+		T_VEC_EACH(i, rows, out[i] = -data[i]);
 		return out;
 	}
 
@@ -205,24 +185,115 @@ public:
 	 * Comparison
 	 **********************************/
 
-	bool operator==(const t_matxx &other) const {
-		for(size_t i = 0; i < rows; ++i) {
-			if(data[i] != other[i])
-				return false;
-		}
+	T_VEC_INLINE bool operator==(const t_matxx &other) const {
+		T_VEC_EACH(i, rows, if(data[i] != other[i]) return false);
 
 		return true;
 	}
 
-	bool operator!=(const t_matxx &other) const {
+	T_VEC_INLINE bool operator!=(const t_matxx &other) const {
 		return !(*this == other);
 	}
+
+	/**********************************
+	 * Square matrix functions
+	 **********************************/
+
+	/**
+	 * Matrix product a * b.
+	 */
+	static T_VEC_FLATTEN t_matxx mul(const t_matxx &a, const t_matxx &b) {
+		static_assert(rows == cols, "mul requires a square matrix");
+		t_matxx out(0);
+		T_VEC_EACH(i, rows, T_VEC_EACH(k, rows, out[i] += a[k] * b[i][k]));
+		return out;
+	}
+
+	static T_VEC_FLATTEN t_matxx transpose(const t_matxx &in) {
+		static_assert(rows == cols, "transpose requires a square matrix");
+		t_matxx out;
+		T_VEC_EACH(i, rows, T_VEC_EACH(j, cols, out[i][j] = in[j][i]));
+		return out;
+	}
 };
 
-#define MATXX_DEFAULTS(tm, tmb)                                                \
-	tm() {}                                                                 \
-	tm(T in) : tmb(in) {} \
-	tm(const tm &other) : tmb(other) {}
+/**
+ * Inverse of a 3x3 matrix through its adjugate, for any 'in'/'out' indexable
+ * as [i][j]. T may itself be a vector, inverting one matrix per component.
+ * Returns the determinant; 'out' is undefined when it is 0.
+ */
+template<typename T, typename In, typename Out>
+static T invert_3x3(const In &a, Out &b) {
+	T b00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+	T b10 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+	T b20 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+	T det = a[0][0] * b00 + a[0][1] * b10 + a[0][2] * b20;
+	T inv = T(1) / det;
+
+	b[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * inv;
+	b[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * inv;
+	b[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * inv;
+	b[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * inv;
+	b[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * inv;
+	b[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * inv;
+	b[0][0] = b00 * inv;
+	b[1][0] = b10 * inv;
+	b[2][0] = b20 * inv;
+	return det;
+}
+
+/**
+ * Inverse of a 4x4 matrix by expansion over 2x2 sub-determinants, for any
+ * 'in'/'out' indexable as [i][j]. Returns the determinant; 'out' is undefined
+ * when it is 0.
+ */
+template<typename T, typename In, typename Out>
+static T invert_4x4(const In &a, Out &b) {
+	T s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+	T s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+	T s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+	T s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+	T s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+	T s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+
+	T c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+	T c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+	T c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+	T c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+	T c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+	T c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+
+	T det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	T inv = T(1) / det;
+
+	T a00 = a[0][0], a01 = a[0][1], a02 = a[0][2], a03 = a[0][3];
+	T a10 = a[1][0], a11 = a[1][1], a12 = a[1][2], a13 = a[1][3];
+	T a20 = a[2][0], a21 = a[2][1], a22 = a[2][2], a23 = a[2][3];
+	T a30 = a[3][0], a31 = a[3][1], a32 = a[3][2], a33 = a[3][3];
+
+	b[0][0] = ( a11 * c5 - a12 * c4 + a13 * c3) * inv;
+	b[0][1] = (-a01 * c5 + a02 * c4 - a03 * c3) * inv;
+	b[0][2] = ( a31 * s5 - a32 * s4 + a33 * s3) * inv;
+	b[0][3] = (-a21 * s5 + a22 * s4 - a23 * s3) * inv;
+	b[1][0] = (-a10 * c5 + a12 * c2 - a13 * c1) * inv;
+	b[1][1] = ( a00 * c5 - a02 * c2 + a03 * c1) * inv;
+	b[1][2] = (-a30 * s5 + a32 * s2 - a33 * s1) * inv;
+	b[1][3] = ( a20 * s5 - a22 * s2 + a23 * s1) * inv;
+	b[2][0] = ( a10 * c4 - a11 * c2 + a13 * c0) * inv;
+	b[2][1] = (-a00 * c4 + a01 * c2 - a03 * c0) * inv;
+	b[2][2] = ( a30 * s4 - a31 * s2 + a33 * s0) * inv;
+	b[2][3] = (-a20 * s4 + a21 * s2 - a23 * s0) * inv;
+	b[3][0] = (-a10 * c3 + a11 * c1 - a12 * c0) * inv;
+	b[3][1] = ( a00 * c3 - a01 * c1 + a02 * c0) * inv;
+	b[3][2] = (-a30 * s3 + a31 * s1 - a32 * s0) * inv;
+	b[3][3] = ( a20 * s3 - a21 * s1 + a22 * s0) * inv;
+	return det;
+}
+
+#define MATXX_DEFAULTS(tm, tmb)                       \
+	T_VEC_INLINE tm() {}                              \
+	T_VEC_INLINE tm(T in) : tmb(in) {}                \
+	tm(const tm &) = default;
 
 #define T_MAT2X2 t_mat<T, t_vec2<T>, t_vec2<T>, t_mat2x2<T>>
 #define T_MAT2X3 t_mat<T, t_vec2<T>, t_vec3<T>, t_mat2x3<T>>
@@ -233,6 +304,7 @@ public:
 #define T_MAT4X2 t_mat<T, t_vec4<T>, t_vec2<T>, t_mat4x2<T>>
 #define T_MAT4X3 t_mat<T, t_vec4<T>, t_vec3<T>, t_mat4x3<T>>
 #define T_MAT4X4 t_mat<T, t_vec4<T>, t_vec4<T>, t_mat4x4<T>>
+#define T_MATN t_mat<T, t_vecn<T, R>, t_vecn<T, C>, t_matn<T, R, C>>
 
 template<typename T>
 struct t_mat2x2 : T_MAT2X2 {
@@ -257,6 +329,15 @@ struct t_mat3x2 : T_MAT3X2 {
 template<typename T>
 struct t_mat3x3 : T_MAT3X3 {
 	MATXX_DEFAULTS(t_mat3x3, T_MAT3X3);
+
+	/**
+	 * Inverse matrix. Undefined for singular matrices.
+	 */
+	static T_VEC_FLATTEN t_mat3x3 inverse(const t_mat3x3 &mat) {
+		t_mat3x3 out;
+		invert_3x3<T>(mat, out);
+		return out;
+	}
 };
 
 template<typename T>
@@ -285,9 +366,10 @@ struct t_mat4x4 : T_MAT4X4 {
 		this->data[3] = v4;
 	}
 
-	static t_mat4x4 perspective(T fov, T aspect, T znear, T zfar) {
+	static T_VEC_FLATTEN t_mat4x4 perspective(T fov, T aspect, T znear,
+			T zfar) {
 		T rad = to_radians(fov);
-		T tan_half_fov = tan(rad / static_cast<T>(2));
+		T tan_half_fov = tangent(rad / static_cast<T>(2));
 		t_mat4x4 out;
 
 		out[0][0] = static_cast<T>(1) / (aspect * tan_half_fov);
@@ -295,11 +377,13 @@ struct t_mat4x4 : T_MAT4X4 {
 		out[2][2] = -(zfar + znear) / (zfar - znear);
 		out[2][3] = -static_cast<T>(1);
 		out[3][2] = -(static_cast<T>(2) * zfar * znear) / (zfar - znear);
+		out[3][3] = 0;
 
 		return out;
 	}
 
-	static t_mat4x4 ortho(T left, T right, T bottom, T top, T znear, T zfar)
+	static T_VEC_FLATTEN t_mat4x4 ortho(T left, T right, T bottom, T top,
+			T znear, T zfar)
 	{
 		t_mat4x4 out;
 		out[0][0] = static_cast<T>(2) / (right - left);
@@ -312,7 +396,8 @@ struct t_mat4x4 : T_MAT4X4 {
 		return out;
 	}
 
-	static t_mat4x4 look_at(t_vec3<T> eye, t_vec3<T> centre, t_vec3<T> up) {
+	static T_VEC_FLATTEN t_mat4x4 look_at(t_vec3<T> eye, t_vec3<T> centre,
+			t_vec3<T> up) {
 		t_vec3<T> f(t_vec3<T>::normalise(centre - eye));
 		t_vec3<T> s(t_vec3<T>::normalise(t_vec3<T>::Cross(f, up)));
 		t_vec3<T> u(t_vec3<T>::Cross(s, f));
@@ -334,18 +419,18 @@ struct t_mat4x4 : T_MAT4X4 {
 		return out;
 	}
 
-	static t_mat4x4 translate(const t_mat4x4 &mat, const t_vec3<T> &v) {
+	static T_VEC_FLATTEN t_mat4x4 translate(const t_mat4x4 &mat,
+			const t_vec3<T> &v) {
 		t_mat4x4 out(mat);
 		out[3] = mat[0] * v[0] + mat[1] * v[1] + mat[2] * v[2] + mat[3];
 		return out;
 	}
 
-	static t_mat4x4 rotate(const t_mat4x4 &mat, T angle, const t_vec3<T> &v) {
-	    T c = cos(to_radians(angle));
-	    T s = sin(to_radians(angle));
-
+	/**
+	 * Rotation about axis 'v' by an angle given as its sine and cosine.
+	 */
+	static T_VEC_FLATTEN t_mat4x4 rotation(T s, T c, const t_vec3<T> &v) {
 		t_mat4x4 rot(0.f);
-		t_mat4x4 out;
 		t_vec3<T> axis = t_vec3<T>::normalise(v);
 		t_vec3<T> temp(axis * (1 - c));
 
@@ -358,6 +443,18 @@ struct t_mat4x4 : T_MAT4X4 {
 		rot[2][0] = 0 + temp[2] * axis[0] + s * axis[1];
 		rot[2][1] = 0 + temp[2] * axis[1] - s * axis[0];
 		rot[2][2] = c + temp[2] * axis[2];
+		rot[3][3] = 1;
+
+		return rot;
+	}
+
+	static T_VEC_FLATTEN t_mat4x4 rotate(const t_mat4x4 &mat, T angle,
+			const t_vec3<T> &v) {
+		T s, c;
+		sin_cos(to_radians(angle), s, c);
+
+		t_mat4x4 rot = rotation(s, c, v);
+		t_mat4x4 out;
 
 		out[0] = mat[0] * rot[0][0] + mat[1] * rot[0][1] + mat[2] * rot[0][2];
 		out[1] = mat[0] * rot[1][0] + mat[1] * rot[1][1] + mat[2] * rot[1][2];
@@ -367,7 +464,46 @@ struct t_mat4x4 : T_MAT4X4 {
 		return out;
 	}
 
-	static t_mat4x4 scale(const t_mat4x4 &mat, const t_vec3<T> &v) {
+	/**
+	 * Rotation matrices for 'count' angles in degrees and axes, evaluating
+	 * the trigonometry in bulk.
+	 */
+	static void rotations(const T *angles, const t_vec3<T> *axes,
+			t_mat4x4 *out, size_t count) {
+		const size_t chunk = 64;
+		T rad[chunk];
+		T s[chunk];
+		T c[chunk];
+
+		for(size_t base = 0; base < count; base += chunk) {
+			size_t n = count - base < chunk ? count - base : chunk;
+			for(size_t i = 0; i < n; ++i)
+				rad[i] = to_radians(angles[base + i]);
+			sin_cos(rad, s, c, n);
+			for(size_t i = 0; i < n; ++i)
+				out[base + i] = rotation(s[i], c[i], axes[base + i]);
+		}
+	}
+
+	/**
+	 * Inverse matrix. Undefined for singular matrices.
+	 */
+	static T_VEC_FLATTEN t_mat4x4 inverse(const t_mat4x4 &mat) {
+		t_mat4x4 out;
+		invert_4x4<T>(mat, out);
+		return out;
+	}
+
+	/**
+	 * Matrix-vector product, mat * v.
+	 */
+	static T_VEC_INLINE t_vec4<T> transform(const t_mat4x4 &mat,
+			const t_vec4<T> &v) {
+		return mat[0] * v[0] + mat[1] * v[1] + mat[2] * v[2] + mat[3] * v[3];
+	}
+
+	static T_VEC_FLATTEN t_mat4x4 scale(const t_mat4x4 &mat,
+			const t_vec3<T> &v) {
 		t_mat4x4 out(mat);
 		out[0] = mat[0] * v[0];
 		out[1] = mat[1] * v[1];
@@ -377,6 +513,15 @@ struct t_mat4x4 : T_MAT4X4 {
 	}
 };
 
+/**
+ * Matrix of any size, R vectors of length C, matching the naming of the
+ * fixed types (t_matn<T, 2, 3> is laid out as t_mat2x3<T>).
+ */
+template<typename T, size_t R, size_t C>
+struct t_matn : T_MATN {
+	MATXX_DEFAULTS(t_matn, T_MATN);
+};
+
 typedef t_mat2x2<float> mat2;
 typedef t_mat2x3<float> mat2x3;
 typedef t_mat2x4<float> mat2x4;
@@ -397,5 +542,6 @@ typedef t_mat4x4<float> mat4;
 #undef T_MAT4X2
 #undef T_MAT4X3
 #undef T_MAT4X4
+#undef T_MATN
 
 #endif
@@ -0,0 +1,335 @@
+#ifndef MESH_H
+#define MESH_H
+
+/**
+ * Normal and tangent generation for indexed triangle meshes.
+ *
+ * Triangles are vec3i indices into the per-vertex arrays. Tangent generation
+ * gathers positions and texture coordinates a block of MESH_BLOCK triangles
+ * at a time into separate component arrays, so its per-corner arithmetic runs
+ * across triangles and vectorises. Normals need too little arithmetic per
+ * triangle to repay the gather, and are computed a triangle at a time.
+ *
+ * Per-vertex results are sums over the triangles sharing a vertex. With a
+ * thread count greater than 1 the triangles are split between threads, and
+ * each thread sums into a private buffer covering only the span of vertex
+ * indices its triangles use. The buffers are then merged per vertex, also in
+ * parallel, so no atomics are needed. Meshes stored roughly in vertex order,
+ * as exporters and scanners write them, keep each span to a small part of
+ * the vertex array. In the worst case every thread holds a full copy.
+ *
+ * Degenerate triangles contribute nothing. Vertices left without a usable
+ * contribution get a zero normal or tangent.
+ */
+
+#include "vec.h"
+#include "parallel.h"
+
+#define MESH_BLOCK 64
+
+/**
+ * Edges p1 - p0 and p2 - p0 of a block of triangles, as component arrays:
+ * e1[c][j] is component c of the first edge of triangle j. Lanes past the
+ * end of a partial block are zero.
+ */
+template<typename T>
+struct t_mesh_edges {
+	T e1[3][MESH_BLOCK];
+	T e2[3][MESH_BLOCK];
+
+	void gather(const t_vec3<T> *pos, const vec3i *tris, size_t n) {
+		if(n < MESH_BLOCK) {
+			for(size_t c = 0; c < 3; ++c) {
+				for(size_t j = n; j < MESH_BLOCK; ++j) {
+					e1[c][j] = 0;
+					e2[c][j] = 0;
+				}
+			}
+		}
+
+		for(size_t j = 0; j < n; ++j) {
+			const t_vec3<T> &p0 = pos[tris[j].x];
+			const t_vec3<T> &p1 = pos[tris[j].y];
+			const t_vec3<T> &p2 = pos[tris[j].z];
+			for(size_t c = 0; c < 3; ++c) {
+				e1[c][j] = p1[c] - p0[c];
+				e2[c][j] = p2[c] - p0[c];
+			}
+		}
+	}
+};
+
+/**
+ * Sum 'width' values per vertex over all triangles, then hand each vertex's
+ * sums to 'finish'.
+ *
+ * 'add(first, last, sums, base)' adds the contributions of triangles
+ * [first, last), where the values for vertex v start at
+ * sums[(v - base) * width]. 'finish(v, sums)' receives the total for vertex
+ * v, and may overwrite it.
+ *
+ * The calling thread sums into 'home', which covers every vertex; the other
+ * threads use private buffers over just their span of vertices, which are
+ * added into 'home' afterwards. 'home' is allocated here if null.
+ */
+template<typename T, size_t width, typename Add, typename Finish>
+static void mesh_accumulate(const vec3i *tris, size_t tri_count,
+		size_t vertex_count, size_t threads, T *home, Add add,
+		Finish finish) {
+	T *part[PARALLEL_MAX_THREADS] = {};
+	size_t base[PARALLEL_MAX_THREADS] = {};
+	size_t end[PARALLEL_MAX_THREADS] = {};
+	T *owned = home ? 0 : new T[vertex_count * width];
+
+	if(!home)
+		home = owned;
+	if(threads > PARALLEL_MAX_THREADS)
+		threads = PARALLEL_MAX_THREADS;
+	if(threads > tri_count)
+		threads = tri_count;
+	if(threads < 1)
+		threads = 1;
+
+	parallel_for(tri_count, threads, [&](size_t t, size_t first,
+			size_t last) {
+		if(t == threads - 1) {
+			for(size_t k = 0; k < vertex_count * width; ++k)
+				home[k] = 0;
+			add(first, last, home, 0);
+			return;
+		}
+
+		size_t lo = vertex_count, hi = 0;
+		for(size_t i = first; i < last; ++i) {
+			for(size_t c = 0; c < 3; ++c) {
+				size_t v = static_cast<size_t>(tris[i][c]);
+				lo = v < lo ? v : lo;
+				hi = v + 1 > hi ? v + 1 : hi;
+			}
+		}
+		if(lo >= hi)
+			return;
+
+		part[t] = new T[(hi - lo) * width]();
+		base[t] = lo;
+		end[t] = hi;
+		add(first, last, part[t], lo);
+	});
+
+	/* Merged a block of vertices at a time, so each span adds as a run. */
+	parallel_for(vertex_count, threads, [&](size_t, size_t first,
+			size_t last) {
+		for(size_t v0 = first; v0 < last; v0 += MESH_BLOCK) {
+			size_t v1 = last - v0 < MESH_BLOCK ? last : v0 + MESH_BLOCK;
+
+			for(size_t t = 0; t + 1 < threads; ++t) {
+				size_t lo = base[t] > v0 ? base[t] : v0;
+				size_t hi = end[t] < v1 ? end[t] : v1;
+				if(lo >= hi)
+					continue;
+
+				const T *src = part[t] + (lo - base[t]) * width;
+				T *dst = home + lo * width;
+				for(size_t k = 0; k < (hi - lo) * width; ++k)
+					dst[k] += src[k];
+			}
+
+			for(size_t v = v0; v < v1; ++v)
+				finish(v, home + v * width);
+		}
+	});
+
+	for(size_t t = 0; t + 1 < threads; ++t)
+		delete[] part[t];
+	delete[] owned;
+}
+
+/**
+ * Normal of a triangle scaled by twice its area.
+ */
+template<typename T>
+static t_vec3<T> mesh_area_normal(const t_vec3<T> *pos, const vec3i &tri) {
+	const t_vec3<T> &p0 = pos[tri.x];
+	return t_vec3<T>::Cross(pos[tri.y] - p0, pos[tri.z] - p0);
+}
+
+/**
+ * Unit normal of each triangle, wound counter-clockwise.
+ */
+template<typename T>
+static void face_normals(const t_vec3<T> *pos, const vec3i *tris,
+		t_vec3<T> *out, size_t count, size_t threads = 1) {
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		for(size_t i = first; i < last; ++i)
+			out[i] = t_vec3<T>::normalise(mesh_area_normal(pos, tris[i]));
+	});
+}
+
+/**
+ * Unit vertex normals, each the sum of the area scaled normals of the
+ * triangles sharing the vertex, so larger triangles carry more weight.
+ */
+template<typename T>
+static void vertex_normals(const t_vec3<T> *pos, size_t vertex_count,
+		const vec3i *tris, size_t tri_count, t_vec3<T> *out,
+		size_t threads = 1) {
+	auto add = [&](size_t first, size_t last, T *sums, size_t base) {
+		for(size_t i = first; i < last; ++i) {
+			t_vec3<T> n = mesh_area_normal(pos, tris[i]);
+			for(size_t c = 0; c < 3; ++c) {
+				size_t v = static_cast<size_t>(tris[i][c]);
+				T *s = sums + (v - base) * 3;
+				s[0] += n.x;
+				s[1] += n.y;
+				s[2] += n.z;
+			}
+		}
+	};
+
+	auto finish = [&](size_t v, const T *sums) {
+		out[v] = t_vec3<T>::normalise(
+				t_vec3<T>(sums[0], sums[1], sums[2]));
+	};
+
+	/* The output doubles as the calling thread's sums. */
+	static_assert(sizeof(t_vec3<T>) == 3 * sizeof(T),
+			"vertex_normals needs vec3 without padding");
+	mesh_accumulate<T, 3>(tris, tri_count, vertex_count, threads,
+			reinterpret_cast<T*>(out), add, finish);
+}
+
+/**
+ * 'in' projected onto the plane normal to 'n' and normalised, across a
+ * block. Lanes that project to zero give zero.
+ */
+template<typename T>
+inline void mesh_block_tangent_plane(const T (&n)[3][MESH_BLOCK],
+		const T (&in)[3][MESH_BLOCK], T (&out)[3][MESH_BLOCK]) {
+	for(size_t j = 0; j < MESH_BLOCK; ++j) {
+		T d = n[0][j] * in[0][j] + n[1][j] * in[1][j] + n[2][j] * in[2][j];
+		T x = in[0][j] - n[0][j] * d;
+		T y = in[1][j] - n[1][j] * d;
+		T z = in[2][j] - n[2][j] * d;
+		T len2 = x * x + y * y + z * z;
+		T s = len2 > 0 ? static_cast<T>(1) / static_cast<T>(sqrt(len2)) : 0;
+		out[0][j] = x * s;
+		out[1][j] = y * s;
+		out[2][j] = z * s;
+	}
+}
+
+/**
+ * Vertex tangents from texture coordinates, following the MikkTSpace
+ * conventions used by glTF and most bakers:
+ *
+ *  - each triangle's tangent and bitangent directions are projected onto the
+ *    plane of each corner's vertex normal and normalised,
+ *  - corners are weighted by their angle, measured between the edges
+ *    projected onto that same plane,
+ *  - out.xyz is the unit tangent and out.w = +-1 the bitangent sign, with
+ *    bitangent = cross(normal, tangent) * w.
+ *
+ * 'normals' should be unit length. Vertices are used as given: unlike the
+ * reference implementation, nothing is split where tangents disagree, so
+ * results match it on meshes whose vertices are already split at UV seams
+ * and hard edges.
+ */
+template<typename T>
+static void vertex_tangents(const t_vec3<T> *pos, const t_vec3<T> *normals,
+		const t_vec2<T> *uvs, size_t vertex_count, const vec3i *tris,
+		size_t tri_count, t_vec4<T> *out, size_t threads = 1) {
+	auto add = [&](size_t first, size_t last, T *sums, size_t base) {
+		t_mesh_edges<T> e;
+		T ft[3][MESH_BLOCK], fb[3][MESH_BLOCK];
+		T n[3][MESH_BLOCK] = {}, a[3][MESH_BLOCK], d[3][MESH_BLOCK];
+		T ct[3][MESH_BLOCK], cb[3][MESH_BLOCK];
+		T weight[MESH_BLOCK];
+
+		for(size_t i = first; i < last; i += MESH_BLOCK) {
+			size_t m = last - i < MESH_BLOCK ? last - i : MESH_BLOCK;
+			T du1[MESH_BLOCK] = {}, dv1[MESH_BLOCK] = {};
+			T du2[MESH_BLOCK] = {}, dv2[MESH_BLOCK] = {};
+
+			e.gather(pos, tris + i, m);
+			for(size_t j = 0; j < m; ++j) {
+				const vec3i &tri = tris[i + j];
+				du1[j] = uvs[tri.y].x - uvs[tri.x].x;
+				dv1[j] = uvs[tri.y].y - uvs[tri.x].y;
+				du2[j] = uvs[tri.z].x - uvs[tri.x].x;
+				dv2[j] = uvs[tri.z].y - uvs[tri.x].y;
+			}
+
+			/*
+			 * Only the direction matters, so the UV area is reduced to its
+			 * sign rather than divided out. Triangles with no UV area get
+			 * zero weight.
+			 */
+			T valid[MESH_BLOCK];
+			for(size_t j = 0; j < MESH_BLOCK; ++j) {
+				T area = du1[j] * dv2[j] - du2[j] * dv1[j];
+				T s = area < 0 ? -1 : 1;
+				valid[j] = area != 0 ? 1 : 0;
+				for(size_t c = 0; c < 3; ++c) {
+					ft[c][j] = s * (e.e1[c][j] * dv2[j] - e.e2[c][j] * dv1[j]);
+					fb[c][j] = s * (e.e2[c][j] * du1[j] - e.e1[c][j] * du2[j]);
+				}
+			}
+
+			for(size_t corner = 0; corner < 3; ++corner) {
+				for(size_t j = 0; j < m; ++j) {
+					const t_vec3<T> &nv = normals[tris[i + j][corner]];
+					for(size_t c = 0; c < 3; ++c)
+						n[c][j] = nv[c];
+				}
+
+				/* The two edges leaving this corner, from e1 and e2. */
+				static const T edge[3][4] = {
+					{ 1, 0, 0, 1 }, { -1, 1, -1, 0 }, { 0, -1, 1, -1 }
+				};
+				const T *k = edge[corner];
+				for(size_t c = 0; c < 3; ++c) {
+					for(size_t j = 0; j < MESH_BLOCK; ++j) {
+						a[c][j] = k[0] * e.e1[c][j] + k[1] * e.e2[c][j];
+						d[c][j] = k[2] * e.e1[c][j] + k[3] * e.e2[c][j];
+					}
+				}
+
+				mesh_block_tangent_plane(n, a, a);
+				mesh_block_tangent_plane(n, d, d);
+				mesh_block_tangent_plane(n, ft, ct);
+				mesh_block_tangent_plane(n, fb, cb);
+
+				for(size_t j = 0; j < m; ++j) {
+					T cosine = a[0][j] * d[0][j] + a[1][j] * d[1][j] +
+						a[2][j] * d[2][j];
+					cosine = cosine < -1 ? -1 : (cosine > 1 ? 1 : cosine);
+					weight[j] = valid[j] * static_cast<T>(acos(cosine));
+				}
+
+				for(size_t j = 0; j < m; ++j) {
+					size_t v = static_cast<size_t>(tris[i + j][corner]);
+					T *s = sums + (v - base) * 6;
+					for(size_t c = 0; c < 3; ++c) {
+						s[c] += ct[c][j] * weight[j];
+						s[c + 3] += cb[c][j] * weight[j];
+					}
+				}
+			}
+		}
+	};
+
+	auto finish = [&](size_t v, const T *sums) {
+		const t_vec3<T> &n = normals[v];
+		t_vec3<T> t(sums[0], sums[1], sums[2]);
+		t_vec3<T> b(sums[3], sums[4], sums[5]);
+
+		t = t_vec3<T>::normalise(t - n * t_vec3<T>::dot(n, t));
+		T w = t_vec3<T>::dot(t_vec3<T>::Cross(n, t), b) < 0 ? -1 : 1;
+		out[v] = t_vec4<T>(t.x, t.y, t.z, w);
+	};
+
+	mesh_accumulate<T, 6>(tris, tri_count, vertex_count, threads,
+			static_cast<T*>(0), add, finish);
+}
+
+#endif
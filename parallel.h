@@ -0,0 +1,42 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/**
+ * Minimal fork/join helper shared by the bulk kernels.
+ *
+ * A range of 'count' items is split into one contiguous sub-range per thread
+ * and passed to a callable taking (thread index, first, last). The calling
+ * thread takes the final sub-range, so a thread count of 1 runs inline with
+ * no threads created. Kernels that reduce keep one partial result per thread
+ * index and merge them afterwards, so no atomics are needed.
+ */
+
+#include <stddef.h>
+#include <thread>
+
+#define PARALLEL_MAX_THREADS 64
+
+template<typename F>
+static void parallel_for(size_t count, size_t threads, F f) {
+	if(threads > PARALLEL_MAX_THREADS)
+		threads = PARALLEL_MAX_THREADS;
+	if(threads > count)
+		threads = count;
+	if(threads <= 1) {
+		f(static_cast<size_t>(0), static_cast<size_t>(0), count);
+		return;
+	}
+
+	std::thread pool[PARALLEL_MAX_THREADS - 1];
+	size_t chunk = count / threads;
+
+	for(size_t t = 0; t < threads - 1; ++t)
+		pool[t] = std::thread(f, t, t * chunk, (t + 1) * chunk);
+
+	f(threads - 1, (threads - 1) * chunk, count);
+
+	for(size_t t = 0; t < threads - 1; ++t)
+		pool[t].join();
+}
+
+#endif
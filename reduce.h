@@ -0,0 +1,265 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+/**
+ * Bulk reductions over arrays of vector types: reduce_bounds, reduce_sum,
+ * reduce_mean and, for three component vectors, reduce_statistics and
+ * reduce_covariance.
+ *
+ * Every reduction works on blocks of REDUCE_BLOCK elements and merges the
+ * partial results, so the same code path serves a single thread and many.
+ * Passing a thread count greater than 1 splits the input with parallel_for
+ * and merges one partial per thread.
+ *
+ * Sums are pairwise, and covariance merges per-block centred co-moments
+ * (Chan et al.), keeping vec3d results stable over very large inputs.
+ */
+
+#include "vec.h"
+#include "mat.h"
+#include "parallel.h"
+
+#define REDUCE_BLOCK 64
+
+/**
+ * Pairwise summation. Error grows with log(count) rather than count.
+ */
+template<typename vecT>
+static vecT reduce_pairwise_sum(const vecT *in, size_t count) {
+	if(count <= REDUCE_BLOCK) {
+		vecT out;
+		for(size_t i = 0; i < count; ++i)
+			out += in[i];
+		return out;
+	}
+
+	size_t half = count / 2;
+	return reduce_pairwise_sum(in, half) +
+		reduce_pairwise_sum(in + half, count - half);
+}
+
+/**
+ * Component-wise min/max of 'count' > 0 vectors. The components of a block
+ * are compared as one flat array against as many running lanes, so the loop
+ * vectorises; a partial last block is padded with the first vector, which
+ * cannot change the result.
+ */
+template<typename vecT>
+static void reduce_bounds_range(const vecT *in, size_t count, vecT &out_min,
+		vecT &out_max) {
+	typedef typename vecT::value_type T;
+	const size_t n = vecT::length;
+	const size_t width = REDUCE_BLOCK * n;
+	static_assert(sizeof(vecT) == n * sizeof(T),
+			"reduce_bounds needs vectors without padding");
+
+	const T *first = reinterpret_cast<const T*>(in);
+	T lo[width], hi[width], pad[width];
+
+	for(size_t k = 0; k < width; ++k)
+		lo[k] = hi[k] = first[k % n];
+
+	for(size_t i = 0; i < count; i += REDUCE_BLOCK) {
+		const T *p = first + i * n;
+		if(count - i < REDUCE_BLOCK) {
+			size_t used = (count - i) * n;
+			for(size_t k = 0; k < width; ++k)
+				pad[k] = k < used ? p[k] : first[k % n];
+			p = pad;
+		}
+
+		for(size_t k = 0; k < width; ++k) {
+			lo[k] = p[k] < lo[k] ? p[k] : lo[k];
+			hi[k] = hi[k] < p[k] ? p[k] : hi[k];
+		}
+	}
+
+	out_min = in[0];
+	out_max = in[0];
+	for(size_t k = 0; k < width; ++k) {
+		size_t c = k % n;
+		out_min[c] = lo[k] < out_min[c] ? lo[k] : out_min[c];
+		out_max[c] = out_max[c] < hi[k] ? hi[k] : out_max[c];
+	}
+}
+
+/**
+ * Component-wise min/max of 'count' vectors. Outputs are left untouched when
+ * count is 0.
+ */
+template<typename vecT>
+static void reduce_bounds(const vecT *in, size_t count, vecT &out_min,
+		vecT &out_max, size_t threads = 1) {
+	if(count == 0)
+		return;
+
+	vecT lo[PARALLEL_MAX_THREADS];
+	vecT hi[PARALLEL_MAX_THREADS];
+
+	if(threads > PARALLEL_MAX_THREADS)
+		threads = PARALLEL_MAX_THREADS;
+	if(threads > count)
+		threads = count;
+
+	parallel_for(count, threads, [&](size_t t, size_t first, size_t last) {
+		reduce_bounds_range(in + first, last - first, lo[t], hi[t]);
+	});
+
+	out_min = lo[0];
+	out_max = hi[0];
+	for(size_t t = 1; t < threads; ++t) {
+		out_min = vecT::min(out_min, lo[t]);
+		out_max = vecT::max(out_max, hi[t]);
+	}
+}
+
+template<typename vecT>
+static vecT reduce_sum(const vecT *in, size_t count, size_t threads = 1) {
+	vecT part[PARALLEL_MAX_THREADS];
+
+	if(threads > PARALLEL_MAX_THREADS)
+		threads = PARALLEL_MAX_THREADS;
+	if(threads > count)
+		threads = count;
+
+	parallel_for(count, threads, [&](size_t t, size_t first, size_t last) {
+		part[t] = reduce_pairwise_sum(in + first, last - first);
+	});
+
+	return reduce_pairwise_sum(part, threads ? threads : 1);
+}
+
+/**
+ * Centroid of 'count' vectors, or zero when count is 0.
+ */
+template<typename vecT>
+static vecT reduce_mean(const vecT *in, size_t count, size_t threads = 1) {
+	if(count == 0)
+		return vecT();
+	typedef typename vecT::value_type T;
+	return reduce_sum(in, count, threads) / static_cast<T>(count);
+}
+
+/**
+ * Running bounds, mean and co-moment of a set of vec3s. Partial results from
+ * separate ranges combine exactly with merge().
+ */
+template<typename T>
+struct t_vec3_stats {
+	size_t count;
+	t_vec3<T> min;
+	t_vec3<T> max;
+	t_vec3<T> mean;
+	t_mat3x3<T> comoment;
+
+	t_vec3_stats() : count(0), comoment(0) {}
+
+	void add(const t_vec3<T> *in, size_t n) {
+		merge(pairwise(in, n));
+	}
+
+	void merge(const t_vec3_stats &other) {
+		if(other.count == 0)
+			return;
+		if(count == 0) {
+			*this = other;
+			return;
+		}
+
+		size_t n = count + other.count;
+		T nb_over_n = static_cast<T>(other.count) / static_cast<T>(n);
+		t_vec3<T> delta = other.mean - mean;
+		t_vec3<T> scaled = delta * (static_cast<T>(count) * nb_over_n);
+
+		for(size_t i = 0; i < 3; ++i)
+			comoment[i] += other.comoment[i] + scaled * delta[i];
+
+		min = t_vec3<T>::min(min, other.min);
+		max = t_vec3<T>::max(max, other.max);
+		mean += delta * nb_over_n;
+		count = n;
+	}
+
+	t_vec3<T> sum() const {
+		return mean * static_cast<T>(count);
+	}
+
+	/**
+	 * Population covariance, or zero when empty.
+	 */
+	t_mat3x3<T> covariance() const {
+		if(count == 0)
+			return t_mat3x3<T>(0);
+		return comoment / static_cast<T>(count);
+	}
+
+private:
+	/**
+	 * Blocks are merged as a balanced tree, as with reduce_pairwise_sum, so the
+	 * running mean is not nudged once per block.
+	 */
+	static t_vec3_stats pairwise(const t_vec3<T> *in, size_t n) {
+		if(n <= REDUCE_BLOCK)
+			return n ? block(in, n) : t_vec3_stats();
+
+		size_t half = n / 2;
+		t_vec3_stats out = pairwise(in, half);
+		out.merge(pairwise(in + half, n - half));
+		return out;
+	}
+
+	/**
+	 * Stats for a single block of at most REDUCE_BLOCK vectors, centred on
+	 * the block mean.
+	 */
+	static t_vec3_stats block(const t_vec3<T> *in, size_t n) {
+		t_vec3_stats out;
+		t_vec3<T> c[REDUCE_BLOCK];
+
+		out.count = n;
+		out.min = in[0];
+		out.max = in[0];
+		out.mean = reduce_pairwise_sum(in, n) / static_cast<T>(n);
+
+		for(size_t i = 0; i < n; ++i) {
+			out.min = t_vec3<T>::min(out.min, in[i]);
+			out.max = t_vec3<T>::max(out.max, in[i]);
+			c[i] = in[i] - out.mean;
+		}
+
+		for(size_t i = 0; i < n; ++i) {
+			out.comoment[0] += c[i] * c[i].x;
+			out.comoment[1] += c[i] * c[i].y;
+			out.comoment[2] += c[i] * c[i].z;
+		}
+
+		return out;
+	}
+};
+
+template<typename T>
+static t_vec3_stats<T> reduce_statistics(const t_vec3<T> *in,
+		size_t count, size_t threads = 1) {
+	t_vec3_stats<T> part[PARALLEL_MAX_THREADS];
+
+	if(threads > PARALLEL_MAX_THREADS)
+		threads = PARALLEL_MAX_THREADS;
+	if(threads > count)
+		threads = count;
+
+	parallel_for(count, threads, [&](size_t t, size_t first, size_t last) {
+		part[t].add(in + first, last - first);
+	});
+
+	for(size_t t = 1; t < threads; ++t)
+		part[0].merge(part[t]);
+	return part[0];
+}
+
+template<typename T>
+static t_mat3x3<T> reduce_covariance(const t_vec3<T> *in, size_t count,
+		size_t threads = 1) {
+	return reduce_statistics(in, count, threads).covariance();
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef RTE_H
+#define RTE_H
+
+/**
+ * Relative-to-eye transforms for worlds larger than float precision.
+ *
+ * Far from the origin a float position only resolves to a large step (about
+ * 1 unit at 1e7), so float model and view matrices jitter. Here positions are
+ * kept in double, or as a high/low pair of floats, and the camera position is
+ * subtracted before narrowing to float. The results are small near the
+ * camera, where precision matters, so the rest of the pipeline stays in
+ * float.
+ *
+ * The high/low form stores d as hi = float(d), lo = float(d - hi), and is
+ * subtracted entirely in float. Its accuracy relies on strict float
+ * evaluation, so it must not be built with -ffast-math.
+ */
+
+#include "vec.h"
+#include "mat.h"
+#include "parallel.h"
+
+/**
+ * Split 'count' double positions into high and low float parts.
+ */
+inline void split_positions(const vec3d *in, vec3 *hi, vec3 *lo,
+		size_t count, size_t threads = 1) {
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		for(size_t i = first; i < last; ++i) {
+			for(size_t k = 0; k < 3; ++k) {
+				float h = static_cast<float>(in[i][k]);
+				hi[i][k] = h;
+				lo[i][k] = static_cast<float>(in[i][k] - h);
+			}
+		}
+	});
+}
+
+/**
+ * out = in - eye, subtracted in double and narrowed to float.
+ */
+inline void relative_to_eye(const vec3d *in, const vec3d &eye, vec3 *out,
+		size_t count, size_t threads = 1) {
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		for(size_t i = first; i < last; ++i)
+			for(size_t k = 0; k < 3; ++k)
+				out[i][k] = static_cast<float>(in[i][k] - eye[k]);
+	});
+}
+
+/**
+ * out = (hi + lo) - eye from split positions, in float. The high parts of
+ * nearby points and the eye cancel exactly, leaving the low parts to supply
+ * the precision.
+ */
+inline void relative_to_eye(const vec3 *hi, const vec3 *lo, const vec3d &eye,
+		vec3 *out, size_t count, size_t threads = 1) {
+	vec3 eye_hi, eye_lo;
+	split_positions(&eye, &eye_hi, &eye_lo, 1);
+
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		for(size_t i = first; i < last; ++i)
+			out[i] = (hi[i] - eye_hi) + (lo[i] - eye_lo);
+	});
+}
+
+/**
+ * Model matrices with their translation made relative to 'eye', narrowed to
+ * float. Combine with view_rotation() of the camera's view matrix.
+ */
+inline void relative_to_eye(const t_mat4x4<double> *in, const vec3d &eye,
+		mat4 *out, size_t count, size_t threads = 1) {
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		for(size_t i = first; i < last; ++i) {
+			for(size_t c = 0; c < 4; ++c)
+				for(size_t r = 0; r < 4; ++r)
+					out[i][c][r] = static_cast<float>(in[i][c][r]);
+			for(size_t r = 0; r < 3; ++r)
+				out[i][3][r] = static_cast<float>(in[i][3][r] - eye[r]);
+		}
+	});
+}
+
+/**
+ * A rigid view matrix with its translation removed, i.e. the view from the
+ * same orientation with the eye at the origin, in float.
+ */
+inline mat4 view_rotation(const t_mat4x4<double> &view) {
+	mat4 out;
+	for(size_t c = 0; c < 3; ++c)
+		for(size_t r = 0; r < 3; ++r)
+			out[c][r] = static_cast<float>(view[c][r]);
+	return out;
+}
+
+#endif
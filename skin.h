@@ -0,0 +1,331 @@
+#ifndef SKIN_H
+#define SKIN_H
+
+/**
+ * Skinning kernels: linear blend of up to four bone matrices per vertex, and
+ * the dual quaternion equivalent for rigid bones.
+ *
+ * Vertex input is described by strided streams, so the same kernel reads
+ * separate arrays (SoA) or fields of an interleaved vertex struct. Output is
+ * always written to tightly packed position and normal arrays.
+ *
+ * Vertices are skinned SKIN_WIDTH at a time, gathered into t_lanes with one
+ * lane per vertex. Bones are still blended per vertex, as vec4 columns or
+ * quaternions, since each vertex indexes its own; the blended result is
+ * spread across lanes, where the transform, normalisation and quaternion
+ * products vectorise.
+ *
+ * Normals are transformed by the blended bone and renormalised, which assumes
+ * bones without non-uniform scale.
+ */
+
+#include <math.h>
+#include "vec.h"
+#include "mat.h"
+#include "batch.h"
+#include "parallel.h"
+
+#define SKIN_WIDTH BATCH_WIDTH
+
+/**
+ * Read-only view of every 'stride' bytes from 'base'.
+ */
+template<typename V>
+struct t_strided {
+	const void *base;
+	size_t stride;
+
+	t_strided() : base(0), stride(sizeof(V)) {}
+	t_strided(const V *base) : base(base), stride(sizeof(V)) {}
+	t_strided(const V *base, size_t stride) : base(base), stride(stride) {}
+
+	const V& operator[](size_t i) const {
+		return *reinterpret_cast<const V*>(
+				static_cast<const char*>(base) + i * stride);
+	}
+};
+
+template<typename T>
+struct t_skin_stream {
+	t_strided<t_vec3<T>> position;
+	t_strided<t_vec3<T>> normal;
+	t_strided<vec4i> bones;
+	t_strided<t_vec4<T>> weights;
+
+	/**
+	 * Separate arrays per attribute. 'normal' may be null.
+	 */
+	static t_skin_stream soa(const t_vec3<T> *position,
+			const t_vec3<T> *normal, const vec4i *bones,
+			const t_vec4<T> *weights) {
+		t_skin_stream out;
+		out.position = position;
+		out.normal = normal;
+		out.bones = bones;
+		out.weights = weights;
+		return out;
+	}
+
+	/**
+	 * Fields of an interleaved vertex struct. 'normal' may be null.
+	 */
+	template<typename V>
+	static t_skin_stream interleaved(const V *verts,
+			t_vec3<T> V::*position, t_vec3<T> V::*normal,
+			vec4i V::*bones, t_vec4<T> V::*weights) {
+		t_skin_stream out;
+		out.position = t_strided<t_vec3<T>>(&(verts->*position), sizeof(V));
+		if(normal)
+			out.normal = t_strided<t_vec3<T>>(&(verts->*normal), sizeof(V));
+		out.bones = t_strided<vec4i>(&(verts->*bones), sizeof(V));
+		out.weights = t_strided<t_vec4<T>>(&(verts->*weights), sizeof(V));
+		return out;
+	}
+};
+
+/**
+ * Rigid transform as a unit dual quaternion. Quaternions are stored as vec4
+ * with the scalar part in w.
+ */
+template<typename T>
+struct t_dual_quat {
+	t_vec4<T> real;
+	t_vec4<T> dual;
+
+	t_dual_quat() : real(0, 0, 0, 1) {}
+	t_dual_quat(const t_vec4<T> &real, const t_vec4<T> &dual) :
+		real(real), dual(dual) {}
+
+	/**
+	 * Rotation and translation of an affine mat4. Scale and shear are not
+	 * representable and must not be present.
+	 */
+	static t_dual_quat from_mat(const t_mat4x4<T> &m) {
+		t_vec4<T> q;
+		T trace = m[0][0] + m[1][1] + m[2][2];
+
+		if(trace > 0) {
+			T s = sqrt(trace + 1) * 2;
+			q = t_vec4<T>((m[1][2] - m[2][1]) / s, (m[2][0] - m[0][2]) / s,
+					(m[0][1] - m[1][0]) / s, s / 4);
+		} else if(m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+			T s = sqrt(1 + m[0][0] - m[1][1] - m[2][2]) * 2;
+			q = t_vec4<T>(s / 4, (m[1][0] + m[0][1]) / s,
+					(m[2][0] + m[0][2]) / s, (m[1][2] - m[2][1]) / s);
+		} else if(m[1][1] > m[2][2]) {
+			T s = sqrt(1 + m[1][1] - m[0][0] - m[2][2]) * 2;
+			q = t_vec4<T>((m[1][0] + m[0][1]) / s, s / 4,
+					(m[2][1] + m[1][2]) / s, (m[2][0] - m[0][2]) / s);
+		} else {
+			T s = sqrt(1 + m[2][2] - m[0][0] - m[1][1]) * 2;
+			q = t_vec4<T>((m[2][0] + m[0][2]) / s, (m[2][1] + m[1][2]) / s,
+					s / 4, (m[0][1] - m[1][0]) / s);
+		}
+
+		/* dual = 0.5 * (t, 0) * q */
+		const t_vec4<T> &t = m[3];
+		t_vec4<T> d(
+			 t.x * q.w + t.y * q.z - t.z * q.y,
+			-t.x * q.z + t.y * q.w + t.z * q.x,
+			 t.x * q.y - t.y * q.x + t.z * q.w,
+			-t.x * q.x - t.y * q.y - t.z * q.z);
+
+		return t_dual_quat(q, d * static_cast<T>(0.5));
+	}
+};
+
+/**
+ * A group of up to SKIN_WIDTH vertices from a stream, one per lane. Lanes past
+ * the end of the range repeat its first vertex and are never written back.
+ */
+template<typename T>
+struct t_skin_lanes {
+	typedef t_lanes<T, SKIN_WIDTH> lane_type;
+
+	lane_type position[3];
+	lane_type normal[3];
+	lane_type weight[4];
+	int bone[4][SKIN_WIDTH];
+	size_t used;
+
+	void gather(const t_skin_stream<T> &in, size_t first, size_t last,
+			bool normals) {
+		used = last - first < SKIN_WIDTH ? last - first : SKIN_WIDTH;
+		for(size_t l = 0; l < SKIN_WIDTH; ++l) {
+			size_t v = first + (l < used ? l : 0);
+			const t_vec3<T> &p = in.position[v];
+			const t_vec4<T> &w = in.weights[v];
+			const vec4i &b = in.bones[v];
+
+			for(size_t c = 0; c < 3; ++c)
+				position[c][l] = p[c];
+			for(size_t k = 0; k < 4; ++k) {
+				weight[k][l] = w[k];
+				bone[k][l] = b[k];
+			}
+			if(normals)
+				for(size_t c = 0; c < 3; ++c)
+					normal[c][l] = in.normal[v][c];
+		}
+	}
+
+	void scatter(const lane_type (&in)[3], t_vec3<T> *out,
+			size_t first) const {
+		for(size_t l = 0; l < used; ++l)
+			out[first + l] = t_vec3<T>(in[0][l], in[1][l], in[2][l]);
+	}
+};
+
+template<typename T, size_t width>
+static void skin_cross(const t_lanes<T, width> (&a)[3],
+		const t_lanes<T, width> (&b)[3], t_lanes<T, width> (&out)[3]) {
+	for(size_t c = 0; c < 3; ++c) {
+		size_t i = (c + 1) % 3, j = (c + 2) % 3;
+		out[c] = a[i] * b[j] - a[j] * b[i];
+	}
+}
+
+/**
+ * Per-lane normalise. Zero vectors stay zero.
+ */
+template<typename T, size_t width>
+static void skin_normalise(t_lanes<T, width> (&v)[3]) {
+	t_lanes<T, width> len2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+	t_lanes<T, width> s;
+	for(size_t l = 0; l < width; ++l)
+		s[l] = len2[l] > 0 ? static_cast<T>(1) / sqrt(len2[l]) : 0;
+	for(size_t c = 0; c < 3; ++c)
+		v[c] = v[c] * s;
+}
+
+/**
+ * Linear blend skinning of 'count' vertices. Bone indices index 'bones', and
+ * weights are expected to sum to 1.
+ */
+template<typename T>
+static void skin_linear(const t_mat4x4<T> *bones, const t_skin_stream<T> &in,
+		t_vec3<T> *out_position, t_vec3<T> *out_normal, size_t count,
+		size_t threads = 1) {
+	typedef typename t_skin_lanes<T>::lane_type lane_type;
+	const bool normals = out_normal && in.normal.base;
+
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		t_skin_lanes<T> v;
+
+		for(size_t i = first; i < last; i += SKIN_WIDTH) {
+			v.gather(in, i, last, normals);
+
+			/*
+			 * Bones are blended a column at a time per vertex, which is
+			 * already vector arithmetic, and only the affine part of the
+			 * result is spread across lanes as m[col][row].
+			 */
+			lane_type m[4][3];
+			for(size_t l = 0; l < SKIN_WIDTH; ++l) {
+				for(size_t c = 0; c < 4; ++c) {
+					t_vec4<T> col = bones[v.bone[0][l]][c] * v.weight[0][l];
+					for(size_t k = 1; k < 4; ++k)
+						col += bones[v.bone[k][l]][c] * v.weight[k][l];
+					for(size_t r = 0; r < 3; ++r)
+						m[c][r][l] = col[r];
+				}
+			}
+
+			lane_type out[3];
+			for(size_t r = 0; r < 3; ++r)
+				out[r] = m[0][r] * v.position[0] + m[1][r] * v.position[1] +
+					m[2][r] * v.position[2] + m[3][r];
+			v.scatter(out, out_position, i);
+
+			if(normals) {
+				for(size_t r = 0; r < 3; ++r)
+					out[r] = m[0][r] * v.normal[0] + m[1][r] * v.normal[1] +
+						m[2][r] * v.normal[2];
+				skin_normalise(out);
+				v.scatter(out, out_normal, i);
+			}
+		}
+	});
+}
+
+/**
+ * Dual quaternion skinning of 'count' vertices. Unlike the linear blend this
+ * preserves volume around twisting joints, but only handles rigid bones.
+ */
+template<typename T>
+static void skin_dual_quat(const t_dual_quat<T> *bones,
+		const t_skin_stream<T> &in, t_vec3<T> *out_position,
+		t_vec3<T> *out_normal, size_t count, size_t threads = 1) {
+	typedef typename t_skin_lanes<T>::lane_type lane_type;
+	const bool normals = out_normal && in.normal.base;
+
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		t_skin_lanes<T> v;
+
+		for(size_t i = first; i < last; i += SKIN_WIDTH) {
+			v.gather(in, i, last, normals);
+
+			/*
+			 * Quaternions are blended per vertex as vec4s, along the
+			 * shortest arc from the first bone, then spread across lanes.
+			 */
+			lane_type real[4], dual[4];
+			for(size_t l = 0; l < SKIN_WIDTH; ++l) {
+				const t_dual_quat<T> &q0 = bones[v.bone[0][l]];
+				t_vec4<T> qr = q0.real * v.weight[0][l];
+				t_vec4<T> qd = q0.dual * v.weight[0][l];
+				for(size_t k = 1; k < 4; ++k) {
+					const t_dual_quat<T> &q = bones[v.bone[k][l]];
+					T w = v.weight[k][l];
+					if(t_vec4<T>::dot(q0.real, q.real) < 0)
+						w = -w;
+					qr += q.real * w;
+					qd += q.dual * w;
+				}
+				for(size_t c = 0; c < 4; ++c) {
+					real[c][l] = qr[c];
+					dual[c][l] = qd[c];
+				}
+			}
+
+			lane_type len2 = real[0] * real[0] + real[1] * real[1] +
+				real[2] * real[2] + real[3] * real[3];
+			lane_type inv;
+			for(size_t l = 0; l < SKIN_WIDTH; ++l)
+				inv[l] = static_cast<T>(1) / sqrt(len2[l]);
+
+			lane_type r[3], dv[3], rw = real[3] * inv, dw = dual[3] * inv;
+			for(size_t c = 0; c < 3; ++c) {
+				r[c] = real[c] * inv;
+				dv[c] = dual[c] * inv;
+			}
+
+			/* t = 2 (dv w - r dw + r x dv), p' = p + 2 r x (r x p + w p) + t */
+			const lane_type two(2);
+			lane_type t[3], rp[3], out[3];
+			skin_cross(r, dv, t);
+			for(size_t c = 0; c < 3; ++c)
+				t[c] = (dv[c] * rw - r[c] * dw + t[c]) * two;
+
+			skin_cross(r, v.position, rp);
+			for(size_t c = 0; c < 3; ++c)
+				rp[c] += v.position[c] * rw;
+			skin_cross(r, rp, out);
+			for(size_t c = 0; c < 3; ++c)
+				out[c] = v.position[c] + out[c] * two + t[c];
+			v.scatter(out, out_position, i);
+
+			if(normals) {
+				skin_cross(r, v.normal, rp);
+				for(size_t c = 0; c < 3; ++c)
+					rp[c] += v.normal[c] * rw;
+				skin_cross(r, rp, out);
+				for(size_t c = 0; c < 3; ++c)
+					out[c] = v.normal[c] + out[c] * two;
+				v.scatter(out, out_normal, i);
+			}
+		}
+	});
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef SOLVE_H
+#define SOLVE_H
+
+/**
+ * Dense linear solvers for small square matrices of any of the matrix types,
+ * including t_matn. Sizes are template parameters, so every loop has a
+ * compile-time trip count and is unrolled by the optimiser.
+ *
+ * Matrices are indexed m[column][row], as elsewhere in the library, and
+ * solve A * x = b for the column vector x.
+ */
+
+#include "vec.h"
+#include "mat.h"
+
+/**
+ * LU decomposition with partial pivoting, PA = LU. L has a unit diagonal and
+ * shares storage with U.
+ */
+template<typename matT>
+struct t_lu {
+	typedef typename matT::value_type T;
+	typedef typename matT::col_type vecT;
+
+	matT lu;
+	size_t perm[matT::rows];
+	bool swapped_odd;
+	bool singular;
+
+	t_lu(const matT &a) : lu(a), swapped_odd(false), singular(false) {
+		static_assert(matT::rows == matT::cols, "LU requires a square matrix");
+		const size_t n = matT::rows;
+
+		for(size_t i = 0; i < n; ++i)
+			perm[i] = i;
+
+		for(size_t k = 0; k < n; ++k) {
+			size_t p = k;
+			T best = abs(lu[k][k]);
+			for(size_t r = k + 1; r < n; ++r) {
+				if(abs(lu[k][r]) > best) {
+					best = abs(lu[k][r]);
+					p = r;
+				}
+			}
+
+			if(best == 0) {
+				singular = true;
+				return;
+			}
+
+			if(p != k) {
+				for(size_t c = 0; c < n; ++c) {
+					T t = lu[c][k];
+					lu[c][k] = lu[c][p];
+					lu[c][p] = t;
+				}
+				size_t t = perm[k];
+				perm[k] = perm[p];
+				perm[p] = t;
+				swapped_odd = !swapped_odd;
+			}
+
+			T inv = 1 / lu[k][k];
+			for(size_t r = k + 1; r < n; ++r) {
+				lu[k][r] *= inv;
+				for(size_t c = k + 1; c < n; ++c)
+					lu[c][r] -= lu[k][r] * lu[c][k];
+			}
+		}
+	}
+
+	/**
+	 * Solution to A * x = b. Undefined when the matrix is singular.
+	 */
+	vecT solve(const vecT &b) const {
+		const size_t n = matT::rows;
+		vecT x;
+
+		for(size_t r = 0; r < n; ++r) {
+			T s = b[perm[r]];
+			for(size_t c = 0; c < r; ++c)
+				s -= lu[c][r] * x[c];
+			x[r] = s;
+		}
+
+		for(size_t r = n; r-- > 0;) {
+			T s = x[r];
+			for(size_t c = r + 1; c < n; ++c)
+				s -= lu[c][r] * x[c];
+			x[r] = s / lu[r][r];
+		}
+
+		return x;
+	}
+
+	T determinant() const {
+		if(singular)
+			return 0;
+
+		T out = swapped_odd ? -1 : 1;
+		for(size_t i = 0; i < matT::rows; ++i)
+			out *= lu[i][i];
+		return out;
+	}
+
+private:
+	static T abs(T in) {
+		return in < 0 ? -in : in;
+	}
+};
+
+/**
+ * Cholesky decomposition A = L * L^T of a symmetric positive definite matrix.
+ * Only the lower triangle of A is read.
+ */
+template<typename matT>
+struct t_cholesky {
+	typedef typename matT::value_type T;
+	typedef typename matT::col_type vecT;
+
+	matT l;
+	bool positive_definite;
+
+	t_cholesky(const matT &a) : l(0), positive_definite(true) {
+		static_assert(matT::rows == matT::cols,
+				"Cholesky requires a square matrix");
+		const size_t n = matT::rows;
+
+		for(size_t j = 0; j < n; ++j) {
+			T d = a[j][j];
+			for(size_t k = 0; k < j; ++k)
+				d -= l[k][j] * l[k][j];
+
+			if(!(d > 0)) {
+				positive_definite = false;
+				return;
+			}
+
+			l[j][j] = sqrt(d);
+			T inv = 1 / l[j][j];
+
+			for(size_t r = j + 1; r < n; ++r) {
+				T s = a[j][r];
+				for(size_t k = 0; k < j; ++k)
+					s -= l[k][r] * l[k][j];
+				l[j][r] = s * inv;
+			}
+		}
+	}
+
+	/**
+	 * Solution to A * x = b. Undefined when A is not positive definite.
+	 */
+	vecT solve(const vecT &b) const {
+		const size_t n = matT::rows;
+		vecT x;
+
+		for(size_t r = 0; r < n; ++r) {
+			T s = b[r];
+			for(size_t c = 0; c < r; ++c)
+				s -= l[c][r] * x[c];
+			x[r] = s / l[r][r];
+		}
+
+		for(size_t r = n; r-- > 0;) {
+			T s = x[r];
+			for(size_t c = r + 1; c < n; ++c)
+				s -= l[r][c] * x[c];
+			x[r] = s / l[r][r];
+		}
+
+		return x;
+	}
+};
+
+/**
+ * Solve A * x = b by LU decomposition. Returns false when A is singular.
+ */
+template<typename matT>
+static bool lu_solve(const matT &a, const typename matT::col_type &b,
+		typename matT::col_type &x) {
+	t_lu<matT> lu(a);
+	if(lu.singular)
+		return false;
+	x = lu.solve(b);
+	return true;
+}
+
+/**
+ * Solve A * x = b by Cholesky decomposition. Returns false when A is not
+ * symmetric positive definite.
+ */
+template<typename matT>
+static bool cholesky_solve(const matT &a, const typename matT::col_type &b,
+		typename matT::col_type &x) {
+	t_cholesky<matT> ch(a);
+	if(!ch.positive_definite)
+		return false;
+	x = ch.solve(b);
+	return true;
+}
+
+#endif
@@ -0,0 +1,580 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+/**
+ * Neighbour queries over vec3 point sets, rebuilt in bulk.
+ *
+ * Space is divided into cubic cells of a chosen size, usually the typical
+ * query radius. build() assigns each point a key from its cell, sorts the
+ * points by key with a parallel radix sort, and keeps a copy of the positions
+ * in that order, so the points of a cell are contiguous in memory. Queries
+ * then visit the cells around a position and test the points within them
+ * with distance_squared().
+ *
+ * Two layouts are provided, sharing build and queries through t_spatial:
+ *
+ *  - t_spatial_grid hashes cells into a table of about one bucket per point.
+ *    A lookup is a single table read, whatever the layout of the points.
+ *  - t_spatial_morton orders cells along a Morton (Z-order) curve, so nearby
+ *    cells are also nearby in memory. Lookups add a short binary search, but
+ *    the better locality makes it the faster of the two for points that
+ *    fill their bounds, especially for nearest neighbour queries.
+ *
+ * Points are referred to by their index in the array given to build(), as
+ * uint32_t. Buffers are kept between builds, so rebuilding every frame with
+ * a similar number of points does not allocate.
+ */
+
+#include <stdint.h>
+#include "vec.h"
+#include "parallel.h"
+#include "reduce.h"
+
+#define SPATIAL_RADIX_BITS 11
+#define SPATIAL_AXIS_BITS 21
+
+/**
+ * Stable sort of 'count' (key, value) pairs by the low 'bits' bits of key,
+ * as one counting sort per digit. Each thread counts and places its own
+ * range, so digits are placed without atomics. 'tmp_keys' and 'tmp_values'
+ * are scratch of the same size.
+ */
+inline void spatial_radix_sort(uint64_t *keys, uint32_t *values,
+		uint64_t *tmp_keys, uint32_t *tmp_values, size_t count,
+		unsigned bits, size_t threads = 1) {
+	if(threads > PARALLEL_MAX_THREADS)
+		threads = PARALLEL_MAX_THREADS;
+	if(threads > count)
+		threads = count;
+	if(threads < 1)
+		threads = 1;
+
+	unsigned passes = (bits + SPATIAL_RADIX_BITS - 1) / SPATIAL_RADIX_BITS;
+	unsigned digit = passes ? (bits + passes - 1) / passes : 0;
+	size_t radix = static_cast<size_t>(1) << digit;
+	size_t *hist = new size_t[threads * radix];
+
+	for(unsigned pass = 0; pass < passes; ++pass) {
+		unsigned shift = pass * digit;
+		uint64_t mask = radix - 1;
+
+		parallel_for(count, threads, [&](size_t t, size_t first,
+				size_t last) {
+			size_t *h = hist + t * radix;
+			for(size_t d = 0; d < radix; ++d)
+				h[d] = 0;
+			for(size_t i = first; i < last; ++i)
+				++h[(keys[i] >> shift) & mask];
+		});
+
+		/* Digit-major, then thread order, keeps the sort stable. */
+		size_t offset = 0;
+		for(size_t d = 0; d < radix; ++d) {
+			for(size_t t = 0; t < threads; ++t) {
+				size_t n = hist[t * radix + d];
+				hist[t * radix + d] = offset;
+				offset += n;
+			}
+		}
+
+		parallel_for(count, threads, [&](size_t t, size_t first,
+				size_t last) {
+			size_t *h = hist + t * radix;
+			for(size_t i = first; i < last; ++i) {
+				size_t to = h[(keys[i] >> shift) & mask]++;
+				tmp_keys[to] = keys[i];
+				tmp_values[to] = values[i];
+			}
+		});
+
+		uint64_t *k = keys;
+		keys = tmp_keys;
+		tmp_keys = k;
+		uint32_t *v = values;
+		values = tmp_values;
+		tmp_values = v;
+	}
+
+	/* After an odd number of passes the result is in the scratch arrays. */
+	if(passes % 2) {
+		parallel_for(count, threads, [&](size_t, size_t first,
+				size_t last) {
+			for(size_t i = first; i < last; ++i) {
+				tmp_keys[i] = keys[i];
+				tmp_values[i] = values[i];
+			}
+		});
+	}
+
+	delete[] hist;
+}
+
+/**
+ * Cell coordinates packed into one integer, SPATIAL_AXIS_BITS per axis.
+ */
+inline uint64_t spatial_pack(const vec3i &c) {
+	return static_cast<uint64_t>(c.x) |
+		static_cast<uint64_t>(c.y) << SPATIAL_AXIS_BITS |
+		static_cast<uint64_t>(c.z) << (2 * SPATIAL_AXIS_BITS);
+}
+
+/**
+ * The low 21 bits of 'v' spread to every third bit.
+ */
+inline uint64_t spatial_spread3(uint64_t v) {
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+inline uint64_t spatial_morton(const vec3i &c) {
+	return spatial_spread3(static_cast<uint64_t>(c.x)) |
+		spatial_spread3(static_cast<uint64_t>(c.y)) << 1 |
+		spatial_spread3(static_cast<uint64_t>(c.z)) << 2;
+}
+
+/**
+ * Build and queries shared by the index layouts. Sorted points are found
+ * through a table of bucket starts, indexed by the top bits of their sort
+ * key, with about one bucket per point. The layout 't_index' provides:
+ *
+ *  - key_bits(): the bits in a sort key, for this->count and this->dims,
+ *  - cell_id(c): a unique id for cell coordinates c,
+ *  - sort_key(id): the key points are sorted by,
+ *  - cell_range(id, first, last): sorted positions that may hold the cell,
+ *    at most those of its bucket.
+ */
+template<typename T, typename t_index>
+struct t_spatial {
+protected:
+	size_t count;
+	size_t capacity;
+	T cell;
+	T inv_cell;
+	t_vec3<T> origin;
+	vec3i dims;
+
+	uint32_t *order;
+	t_vec3<T> *points;
+	uint64_t *cells;
+	uint64_t *keys;
+	uint64_t *tmp_keys;
+	uint32_t *tmp_order;
+
+	unsigned bits;
+	uint32_t *start;
+	size_t buckets;
+	unsigned shift;
+
+	t_spatial() : count(0), capacity(0), cell(1), inv_cell(1), dims(0),
+		order(0), points(0), cells(0), keys(0), tmp_keys(0), tmp_order(0),
+		bits(0), start(0), buckets(0), shift(0) {}
+
+	~t_spatial() {
+		release();
+		delete[] start;
+	}
+
+	void release() {
+		delete[] order;
+		delete[] points;
+		delete[] cells;
+		delete[] keys;
+		delete[] tmp_keys;
+		delete[] tmp_order;
+		order = 0;
+		points = 0;
+		cells = 0;
+		keys = 0;
+		tmp_keys = 0;
+		tmp_order = 0;
+		capacity = 0;
+	}
+
+	const t_index& index() const {
+		return static_cast<const t_index&>(*this);
+	}
+
+	t_index& index() {
+		return static_cast<t_index&>(*this);
+	}
+
+	/**
+	 * Cell coordinates of 'p', which may lie outside the grid. Points far
+	 * outside are brought to just past its edge, which keeps the distance
+	 * bounds used by nearest() valid.
+	 */
+	vec3i cell_of(const t_vec3<T> &p) const {
+		/* Shifted by one cell so truncation rounds down, without floor(). */
+		const T edge = static_cast<T>((1 << SPATIAL_AXIS_BITS) + 1);
+		t_vec3<T> c = t_vec3<T>::clamp((p - origin) * inv_cell + t_vec3<T>(1),
+				t_vec3<T>(0), t_vec3<T>(edge));
+		return vec3i(static_cast<int>(c.x), static_cast<int>(c.y),
+				static_cast<int>(c.z)) - vec3i(1);
+	}
+
+	vec3i clamp_cell(const vec3i &c) const {
+		return vec3i::clamp(c, vec3i(0), dims - vec3i(1));
+	}
+
+	/**
+	 * Bits of bucket table for 'count' points: at least one bucket each.
+	 */
+	static unsigned table_bits(size_t count) {
+		unsigned b = 6;
+		while((static_cast<size_t>(1) << b) < count)
+			++b;
+		return b;
+	}
+
+	void bucket_range(uint64_t key, size_t &first, size_t &last) const {
+		size_t b = static_cast<size_t>(key >> shift);
+		first = start[b];
+		last = start[b + 1];
+	}
+
+	/**
+	 * Each sorted position fills the starts of the buckets between its own
+	 * and the previous one's, so threads write disjoint entries.
+	 */
+	void fill_buckets(size_t threads) {
+		parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+			for(size_t j = first; j < last; ++j) {
+				size_t from = j ? static_cast<size_t>(keys[j - 1] >> shift) + 1
+					: 0;
+				size_t to = static_cast<size_t>(keys[j] >> shift);
+				for(size_t b = from; b <= to; ++b)
+					start[b] = static_cast<uint32_t>(j);
+			}
+		});
+
+		size_t from = count ? static_cast<size_t>(keys[count - 1] >> shift) + 1
+			: 0;
+		for(size_t b = from; b <= buckets; ++b)
+			start[b] = static_cast<uint32_t>(count);
+	}
+
+	/**
+	 * Call f(sorted position) for every point in cell 'c', which must lie
+	 * in the grid.
+	 */
+	template<typename F>
+	void visit_cell(const vec3i &c, F f) const {
+		uint64_t id = index().cell_id(c);
+		size_t first, last;
+		index().cell_range(id, first, last);
+		for(size_t j = first; j < last; ++j)
+			if(cells[j] == id)
+				f(j);
+	}
+
+	/**
+	 * Insert (index, d2) into the 'n' best so far, kept sorted by distance,
+	 * of at most 'k'.
+	 */
+	static void keep_nearest(uint32_t index, T d2, uint32_t *out,
+			T *out_d2, size_t &n, size_t k) {
+		if(n == k && d2 >= out_d2[n - 1])
+			return;
+
+		size_t i = n < k ? n++ : n - 1;
+		for(; i > 0 && out_d2[i - 1] > d2; --i) {
+			out[i] = out[i - 1];
+			out_d2[i] = out_d2[i - 1];
+		}
+		out[i] = index;
+		out_d2[i] = d2;
+	}
+
+public:
+	t_spatial(const t_spatial&) = delete;
+	t_spatial& operator=(const t_spatial&) = delete;
+
+	size_t size() const {
+		return count;
+	}
+
+	T cell_size() const {
+		return cell;
+	}
+
+	/**
+	 * Index 'count' points into cells of size 'cell_size'. The cell size is
+	 * raised if needed so the points span at most 2^21 cells per axis.
+	 */
+	void build(const t_vec3<T> *pos, size_t count, T cell_size,
+			size_t threads = 1) {
+		if(count > capacity) {
+			release();
+			order = new uint32_t[count];
+			points = new t_vec3<T>[count];
+			cells = new uint64_t[count];
+			keys = new uint64_t[count];
+			tmp_keys = new uint64_t[count];
+			tmp_order = new uint32_t[count];
+			capacity = count;
+		}
+		this->count = count;
+		if(threads > PARALLEL_MAX_THREADS)
+			threads = PARALLEL_MAX_THREADS;
+
+		t_vec3<T> lo(0), hi(0);
+		reduce_bounds(pos, count, lo, hi, threads);
+
+		const T max_cells = static_cast<T>((1 << SPATIAL_AXIS_BITS) - 1);
+		t_vec3<T> extent = hi - lo;
+		T widest = extent.x > extent.y ? extent.x : extent.y;
+		widest = widest > extent.z ? widest : extent.z;
+		cell = cell_size * max_cells < widest ? widest / max_cells : cell_size;
+		inv_cell = 1 / cell;
+		origin = lo;
+		dims = vec3i::min(cell_of(hi) + vec3i(1),
+				vec3i(1 << SPATIAL_AXIS_BITS));
+
+		bits = index().key_bits();
+		unsigned table = table_bits(count);
+		table = table < bits ? table : bits;
+		shift = bits - table;
+		if(static_cast<size_t>(1) << table != buckets) {
+			delete[] start;
+			buckets = static_cast<size_t>(1) << table;
+			start = new uint32_t[buckets + 1];
+		}
+
+		parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+			for(size_t i = first; i < last; ++i) {
+				keys[i] = index().sort_key(
+						index().cell_id(clamp_cell(cell_of(pos[i]))));
+				order[i] = static_cast<uint32_t>(i);
+			}
+		});
+
+		spatial_radix_sort(keys, order, tmp_keys, tmp_order, count, bits,
+				threads);
+
+		parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+			/* Separate passes keep the random reads free of other work. */
+			for(size_t j = first; j < last; ++j)
+				points[j] = pos[order[j]];
+			for(size_t j = first; j < last; ++j)
+				cells[j] = index().cell_id(clamp_cell(cell_of(points[j])));
+		});
+
+		fill_buckets(threads);
+	}
+
+	/**
+	 * Call f(index, distance squared) for every point within 'radius' of
+	 * 'p', in no particular order.
+	 */
+	template<typename F>
+	void radius(const t_vec3<T> &p, T radius, F f) const {
+		if(count == 0)
+			return;
+
+		const T r2 = radius * radius;
+		vec3i lo = clamp_cell(cell_of(p - t_vec3<T>(radius)));
+		vec3i hi = clamp_cell(cell_of(p + t_vec3<T>(radius)));
+
+		for(int z = lo.z; z <= hi.z; ++z) {
+			for(int y = lo.y; y <= hi.y; ++y) {
+				for(int x = lo.x; x <= hi.x; ++x) {
+					visit_cell(vec3i(x, y, z), [&](size_t j) {
+						T d2 = t_vec3<T>::distance_squared(points[j], p);
+						if(d2 <= r2)
+							f(order[j], d2);
+					});
+				}
+			}
+		}
+	}
+
+	/**
+	 * radius() for each of 'n' queries, split across threads. Calls
+	 * f(thread, query, index, distance squared), so results can be gathered
+	 * per thread without locking.
+	 */
+	template<typename F>
+	void radius(const t_vec3<T> *queries, size_t n, T radius, F f,
+			size_t threads = 1) const {
+		parallel_for(n, threads, [&](size_t t, size_t first, size_t last) {
+			for(size_t q = first; q < last; ++q) {
+				this->radius(queries[q], radius, [&](uint32_t i, T d2) {
+					f(t, q, i, d2);
+				});
+			}
+		});
+	}
+
+	/**
+	 * The 'k' points nearest 'p', closest first, written to 'out' with
+	 * their squared distances in 'out_d2'. Returns how many were found,
+	 * which is less than k only when there are fewer points.
+	 *
+	 * Cells are searched in cubic shells around p. After shell s, every
+	 * unvisited point is at least s cells away, so the search stops once
+	 * the k-th best is closer than that. Each shell costs about s^2 cell
+	 * lookups, so the cell size should be near the spacing of the points.
+	 */
+	size_t nearest(const t_vec3<T> &p, size_t k, uint32_t *out,
+			T *out_d2) const {
+		size_t n = 0;
+		if(k == 0 || count == 0)
+			return 0;
+
+		vec3i c = vec3i::clamp(cell_of(p), vec3i(-1), dims);
+		vec3i far = vec3i::max(vec3i::abs(c), vec3i::abs(dims - vec3i(1) - c));
+		int last = far.x > far.y ? far.x : far.y;
+		last = last > far.z ? last : far.z;
+
+		auto consider = [&](size_t j) {
+			T d2 = t_vec3<T>::distance_squared(points[j], p);
+			keep_nearest(order[j], d2, out, out_d2, n, k);
+		};
+
+		for(int s = 0; s <= last; ++s) {
+			vec3i lo = vec3i::max(c - vec3i(s), vec3i(0));
+			vec3i hi = vec3i::min(c + vec3i(s), dims - vec3i(1));
+
+			for(int z = lo.z; z <= hi.z; ++z) {
+				for(int y = lo.y; y <= hi.y; ++y) {
+					bool face = z == c.z - s || z == c.z + s ||
+						y == c.y - s || y == c.y + s;
+					if(face) {
+						for(int x = lo.x; x <= hi.x; ++x)
+							visit_cell(vec3i(x, y, z), consider);
+					} else {
+						if(c.x - s >= 0 && c.x - s < dims.x)
+							visit_cell(vec3i(c.x - s, y, z), consider);
+						if(s > 0 && c.x + s >= 0 && c.x + s < dims.x)
+							visit_cell(vec3i(c.x + s, y, z), consider);
+					}
+				}
+			}
+
+			/*
+			 * Distance in cells from p to the nearest face of the searched
+			 * cube, which is at least s.
+			 */
+			T reach = static_cast<T>(s + 1);
+			for(size_t a = 0; a < 3; ++a) {
+				T u = (p[a] - origin[a]) * inv_cell - static_cast<T>(c[a] - s);
+				T v = static_cast<T>(2 * s + 1) - u;
+				T gap = u < v ? u : v;
+				gap = gap > s ? gap : static_cast<T>(s);
+				reach = reach < gap ? reach : gap;
+			}
+			reach *= cell;
+			if(n == k && out_d2[k - 1] <= reach * reach)
+				break;
+		}
+
+		return n;
+	}
+
+	/**
+	 * nearest() for each of 'n' queries, split across threads. Query q
+	 * writes to out[q * k] and out_d2[q * k], and its count to found[q] if
+	 * 'found' is not null.
+	 */
+	void nearest(const t_vec3<T> *queries, size_t n, size_t k,
+			uint32_t *out, T *out_d2, size_t *found = 0,
+			size_t threads = 1) const {
+		parallel_for(n, threads, [&](size_t, size_t first, size_t last) {
+			for(size_t q = first; q < last; ++q) {
+				size_t m = nearest(queries[q], k, out + q * k,
+						out_d2 + q * k);
+				if(found)
+					found[q] = m;
+			}
+		});
+	}
+};
+
+/**
+ * Cells hashed into the bucket table, so only occupied cells cost memory.
+ * Cells sharing a bucket are told apart by their id.
+ */
+template<typename T>
+struct t_spatial_grid : t_spatial<T, t_spatial_grid<T>> {
+private:
+	friend struct t_spatial<T, t_spatial_grid<T>>;
+
+	unsigned key_bits() const {
+		return this->table_bits(this->count);
+	}
+
+	uint64_t cell_id(const vec3i &c) const {
+		return spatial_pack(c);
+	}
+
+	uint64_t sort_key(uint64_t id) const {
+		uint64_t h = id * 0x9e3779b97f4a7c15ull;
+		return h >> (64 - this->bits);
+	}
+
+	void cell_range(uint64_t id, size_t &first, size_t &last) const {
+		this->bucket_range(sort_key(id), first, last);
+	}
+};
+
+/**
+ * Cells ordered by Morton code, using only as many bits per axis as the
+ * grid needs. A bucket holds a run of codes, searched for the cell's own.
+ */
+template<typename T>
+struct t_spatial_morton : t_spatial<T, t_spatial_morton<T>> {
+private:
+	friend struct t_spatial<T, t_spatial_morton<T>>;
+
+	unsigned key_bits() const {
+		const vec3i &d = this->dims;
+		int widest = d.x > d.y ? d.x : d.y;
+		widest = widest > d.z ? widest : d.z;
+
+		unsigned b = 0;
+		while((1 << b) < widest)
+			++b;
+		return 3 * b;
+	}
+
+	uint64_t cell_id(const vec3i &c) const {
+		return spatial_morton(c);
+	}
+
+	uint64_t sort_key(uint64_t id) const {
+		return id;
+	}
+
+	void cell_range(uint64_t id, size_t &first, size_t &last) const {
+		const uint64_t *cells = this->cells;
+		size_t lo, end;
+		this->bucket_range(id, lo, end);
+
+		size_t hi = end;
+		while(lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if(cells[mid] < id)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		first = lo;
+
+		hi = end;
+		while(lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if(cells[mid] <= id)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		last = lo;
+	}
+};
+
+#endif
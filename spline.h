@@ -0,0 +1,176 @@
+#ifndef SPLINE_H
+#define SPLINE_H
+
+/**
+ * Batched cubic curve evaluation.
+ *
+ * The basis is chosen by a tag type: spline_hermite, spline_catmull_rom,
+ * spline_bezier or spline_bspline, matching the t_vec functions of the same
+ * names.
+ *
+ * spline_eval() evaluates many independent curves, one parameter each, from
+ * control values stored as separate arrays per component (t_spline_soa).
+ * Blocks of SPLINE_BLOCK curves are evaluated at once: basis weights first,
+ * then each component, so the arithmetic runs across curves and vectorises.
+ * spline_sample() evaluates one piecewise curve of any vector type at many
+ * parameters.
+ *
+ * Passing a thread count greater than 1 splits the parameters with
+ * parallel_for.
+ */
+
+#include "vec.h"
+#include "parallel.h"
+
+#define SPLINE_BLOCK 64
+
+/**
+ * Basis tags. 'step' is the number of points between consecutive segments
+ * of a piecewise curve, where the basis takes four points. Hermite points
+ * alternate value and tangent, so segments share a (p, m) pair.
+ */
+struct spline_hermite {
+	static constexpr size_t step = 2;
+
+	template<typename T>
+	static void weights(T t, T *w) {
+		hermite_weights(t, w);
+	}
+};
+
+struct spline_catmull_rom {
+	static constexpr size_t step = 1;
+
+	template<typename T>
+	static void weights(T t, T *w) {
+		catmull_rom_weights(t, w);
+	}
+};
+
+struct spline_bezier {
+	static constexpr size_t step = 3;
+
+	template<typename T>
+	static void weights(T t, T *w) {
+		bezier_weights(t, w);
+	}
+};
+
+struct spline_bspline {
+	static constexpr size_t step = 1;
+
+	template<typename T>
+	static void weights(T t, T *w) {
+		bspline_weights(t, w);
+	}
+};
+
+/**
+ * Control values of many curves with 'dim' components, as separate arrays:
+ * control[k][c][i] is component c of control value k of curve i. For
+ * spline_hermite the control values are (p0, m0, p1, m1).
+ */
+template<typename T, size_t dim>
+struct t_spline_soa {
+	const T *control[4][dim];
+};
+
+/**
+ * Weights for one block of parameters, stored per control value: w[k][i].
+ */
+template<typename basis, typename T>
+inline void spline_block_weights(const T *t, T (&w)[4][SPLINE_BLOCK]) {
+	for(size_t i = 0; i < SPLINE_BLOCK; ++i) {
+		T wi[4];
+		basis::weights(t[i], wi);
+		w[0][i] = wi[0];
+		w[1][i] = wi[1];
+		w[2][i] = wi[2];
+		w[3][i] = wi[3];
+	}
+}
+
+/**
+ * One component of one block of curves. The fixed trip count and
+ * non-aliasing arrays let this vectorise across curves even at -O2.
+ */
+template<typename T>
+inline void spline_block_apply(const T (&w)[4][SPLINE_BLOCK],
+		const T *__restrict a, const T *__restrict b, const T *__restrict c,
+		const T *__restrict d, T *__restrict out) {
+	for(size_t i = 0; i < SPLINE_BLOCK; ++i)
+		out[i] = w[0][i] * a[i] + w[1][i] * b[i] + w[2][i] * c[i] +
+			w[3][i] * d[i];
+}
+
+/**
+ * out[c][i] = curve i at t[i], for 'count' curves.
+ */
+template<typename basis, typename T, size_t dim>
+static void spline_eval(const t_spline_soa<T, dim> &in, const T *t,
+		T *const *out, size_t count, size_t threads = 1) {
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		T w[4][SPLINE_BLOCK];
+		size_t i = first;
+
+		for(; i + SPLINE_BLOCK <= last; i += SPLINE_BLOCK) {
+			spline_block_weights<basis>(t + i, w);
+			for(size_t c = 0; c < dim; ++c)
+				spline_block_apply(w, in.control[0][c] + i,
+						in.control[1][c] + i, in.control[2][c] + i,
+						in.control[3][c] + i, out[c] + i);
+		}
+
+		/* The last partial block runs through zero padded copies. */
+		size_t n = last - i;
+		if(n == 0)
+			return;
+
+		T pad[6][SPLINE_BLOCK] = {};
+		for(size_t j = 0; j < n; ++j)
+			pad[0][j] = t[i + j];
+		spline_block_weights<basis>(pad[0], w);
+
+		for(size_t c = 0; c < dim; ++c) {
+			for(size_t k = 0; k < 4; ++k)
+				for(size_t j = 0; j < n; ++j)
+					pad[k + 1][j] = in.control[k][c][i + j];
+			spline_block_apply(w, pad[1], pad[2], pad[3], pad[4], pad[5]);
+			for(size_t j = 0; j < n; ++j)
+				out[c][i + j] = pad[5][j];
+		}
+	});
+}
+
+/**
+ * Sample the piecewise curve through 'points' at each of 'count'
+ * parameters. Segment s starts at points[s * basis::step], and parameter t
+ * maps to segment floor(t) at local t - floor(t). Parameters are clamped to
+ * [0, segments], where segments = (n - 4) / step + 1, and NaN samples the
+ * start. Requires n >= 4.
+ */
+template<typename basis, typename vecT>
+static void spline_sample(const vecT *points, size_t n,
+		const typename vecT::value_type *t, vecT *out, size_t count,
+		size_t threads = 1) {
+	typedef typename vecT::value_type T;
+	const size_t segments = (n - 4) / basis::step + 1;
+	const T end = static_cast<T>(segments);
+
+	parallel_for(count, threads, [&](size_t, size_t first, size_t last) {
+		for(size_t i = first; i < last; ++i) {
+			/* Written so NaN fails both tests and becomes 0 before the cast. */
+			T u = t[i] > 0 ? (t[i] < end ? t[i] : end) : 0;
+			size_t seg = static_cast<size_t>(u);
+			if(seg == segments)
+				--seg;
+
+			T w[4];
+			basis::weights(u - static_cast<T>(seg), w);
+			const vecT *p = points + seg * basis::step;
+			out[i] = vecT::blend(p[0], p[1], p[2], p[3], w);
+		}
+	});
+}
+
+#endif
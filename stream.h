@@ -0,0 +1,241 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+/**
+ * Out-of-core processing of point clouds stored as raw arrays of vec3 or
+ * vec3d, for datasets larger than memory.
+ *
+ * stream_points() reads fixed size chunks from a FILE, runs a stage over
+ * each chunk in place, folds the surviving points into a t_vec3_stats and
+ * writes them out. Three chunk buffers rotate between reading, processing and
+ * writing. A reader and a writer thread, started once per call, take buffers
+ * in turn from the caller's thread, so disk and compute overlap however small
+ * the chunks. Peak memory is three chunks whatever the size of the input.
+ *
+ * A stage is any callable taking (t_vec3<T> *points, size_t n) and returning
+ * the number of points kept, which it compacts to the front of the array. T
+ * is taken from that argument. t_stream_transform and t_stream_filter are
+ * provided, and stream_chain() joins stages.
+ */
+
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "vec.h"
+#include "mat.h"
+#include "reduce.h"
+
+#define STREAM_CHUNK 65536
+
+/**
+ * Scalar type of a stage, from the points its call operator takes.
+ */
+template<typename M>
+struct t_stream_arg;
+
+template<typename C, typename R, typename V>
+struct t_stream_arg<R (C::*)(V*, size_t) const> {
+	typedef typename V::value_type type;
+};
+
+template<typename C, typename R, typename V>
+struct t_stream_arg<R (C::*)(V*, size_t)> {
+	typedef typename V::value_type type;
+};
+
+template<typename F>
+struct t_stream_value : t_stream_arg<decltype(&F::operator())> {};
+
+template<typename R, typename V>
+struct t_stream_value<R (*)(V*, size_t)> {
+	typedef typename V::value_type type;
+};
+
+/**
+ * Applies a mat4 to every point, as a position (w = 1).
+ */
+template<typename T>
+struct t_stream_transform {
+	t_mat4x4<T> mat;
+
+	t_stream_transform(const t_mat4x4<T> &mat) : mat(mat) {}
+
+	size_t operator()(t_vec3<T> *points, size_t n) const {
+		for(size_t i = 0; i < n; ++i) {
+			const t_vec3<T> &p = points[i];
+			t_vec4<T> o = t_mat4x4<T>::transform(mat,
+					t_vec4<T>(p.x, p.y, p.z, 1));
+			points[i] = t_vec3<T>(o.x, o.y, o.z);
+		}
+		return n;
+	}
+};
+
+/**
+ * Keeps the points for which 'pred' returns true, preserving order.
+ */
+template<typename T, typename F>
+struct t_stream_filter {
+	F pred;
+
+	t_stream_filter(F pred) : pred(pred) {}
+
+	size_t operator()(t_vec3<T> *points, size_t n) const {
+		size_t kept = 0;
+		for(size_t i = 0; i < n; ++i)
+			if(pred(points[i]))
+				points[kept++] = points[i];
+		return kept;
+	}
+};
+
+template<typename A, typename B>
+struct t_stream_chain {
+	typedef typename t_stream_value<A>::type T;
+
+	A a;
+	B b;
+
+	t_stream_chain(const A &a, const B &b) : a(a), b(b) {}
+
+	size_t operator()(t_vec3<T> *points, size_t n) const {
+		return b(points, a(points, n));
+	}
+};
+
+template<typename T>
+static t_stream_transform<T> stream_transform(const t_mat4x4<T> &mat) {
+	return t_stream_transform<T>(mat);
+}
+
+template<typename T, typename F>
+static t_stream_filter<T, F> stream_filter(F pred) {
+	return t_stream_filter<T, F>(pred);
+}
+
+/**
+ * Stage running 'a' then 'b'. Nest for longer chains.
+ */
+template<typename A, typename B>
+static t_stream_chain<A, B> stream_chain(const A &a, const B &b) {
+	return t_stream_chain<A, B>(a, b);
+}
+
+/**
+ * Hand-over of stream_points() buffers. Chunk j lives in buffer j % 3 and
+ * passes from the reader to the caller to the writer; the counters only grow,
+ * and the reader reuses a buffer once its previous chunk is written.
+ */
+struct t_stream_pipe {
+	std::mutex lock;
+	std::condition_variable changed;
+	size_t read;
+	size_t processed;
+	size_t written;
+	bool read_done;
+	bool process_done;
+
+	t_stream_pipe() : read(0), processed(0), written(0), read_done(false),
+		process_done(false) {}
+
+	template<typename F>
+	void wait(F ready) {
+		std::unique_lock<std::mutex> hold(lock);
+		changed.wait(hold, ready);
+	}
+
+	/* Moves 'counter' on one chunk, optionally marking its stage done. */
+	void advance(size_t &counter, bool *done = 0) {
+		{
+			std::lock_guard<std::mutex> hold(lock);
+			++counter;
+			if(done)
+				*done = true;
+		}
+		changed.notify_all();
+	}
+};
+
+/**
+ * Stream every point from 'in' through 'stage' into 'out', in chunks of
+ * 'chunk' points. 'out' and 'stats' may be null. Statistics are reduced with
+ * 'threads' threads. Returns false on a read or write error; a trailing
+ * partial point in the input is ignored.
+ */
+template<typename F>
+static bool stream_points(FILE *in, FILE *out, F stage,
+		t_vec3_stats<typename t_stream_value<F>::type> *stats = 0,
+		size_t chunk = STREAM_CHUNK, size_t threads = 1) {
+	typedef typename t_stream_value<F>::type T;
+	static_assert(sizeof(t_vec3<T>) == 3 * sizeof(T),
+			"vec3 must be tightly packed to stream");
+	if(chunk == 0)
+		chunk = 1;
+
+	t_vec3<T> *buffers = new t_vec3<T>[3 * chunk];
+	size_t filled[3], kept[3];
+	bool wrote = true;
+	t_stream_pipe pipe;
+
+	/* A short read means end of input, and is the last chunk. */
+	std::thread reader([&]() {
+		for(size_t j = 0; ; ++j) {
+			pipe.wait([&]() { return pipe.written + 3 > j; });
+			size_t n = fread(buffers + j % 3 * chunk, sizeof(t_vec3<T>),
+					chunk, in);
+			filled[j % 3] = n;
+			pipe.advance(pipe.read, n < chunk ? &pipe.read_done : 0);
+			if(n < chunk)
+				return;
+		}
+	});
+
+	std::thread writer([&]() {
+		for(size_t j = 0; ; ++j) {
+			bool ready;
+			pipe.wait([&]() {
+				ready = pipe.processed > j;
+				return ready || pipe.process_done;
+			});
+			if(!ready)
+				return;
+			size_t n = kept[j % 3];
+			if(out && n && fwrite(buffers + j % 3 * chunk, sizeof(t_vec3<T>),
+						n, out) != n)
+				wrote = false;
+			pipe.advance(pipe.written);
+		}
+	});
+
+	for(size_t k = 0; ; ++k) {
+		bool ready;
+		pipe.wait([&]() {
+			ready = pipe.read > k;
+			return ready || pipe.read_done;
+		});
+		if(!ready)
+			break;
+
+		t_vec3<T> *data = buffers + k % 3 * chunk;
+		size_t n = stage(data, filled[k % 3]);
+		if(stats)
+			stats->merge(reduce_statistics(data, n, threads));
+		kept[k % 3] = n;
+		pipe.advance(pipe.processed);
+	}
+
+	{
+		std::lock_guard<std::mutex> hold(pipe.lock);
+		pipe.process_done = true;
+	}
+	pipe.changed.notify_all();
+
+	reader.join();
+	writer.join();
+
+	delete[] buffers;
+	return wrote && !ferror(in);
+}
+
+#endif
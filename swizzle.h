@@ -0,0 +1,252 @@
+#ifndef SWIZZLE_H
+#define SWIZZLE_H
+
+/**
+ * Swizzle proxies for the named vector types, called as functions: v.zyx(),
+ * v.xy().
+ *
+ * A t_swizzle refers back to the vector it came from and works on the
+ * selected components in place. Compound assignments update each component
+ * directly, and arithmetic builds only its result; a whole vector is only
+ * gathered when the swizzle is converted or assigned from a vector that may
+ * overlap it. It converts implicitly to the matching vector type, so swizzles
+ * combine with vectors on either side of an operator.
+ *
+ * Swizzles of a non-const vector are writable when no component repeats:
+ * v.xy() = vec2(1, 2) is legal, v.xx() = vec2(1, 2) fails to compile.
+ *
+ * Accessors are generated per members policy by T_VEC_SWIZZLES. By default
+ * these are the 2 and 3 component swizzles under the xyzw names. Defining
+ * T_VEC_SWIZZLE_ALL before including vec.h adds 4 component swizzles and the
+ * rgba names, which makes vec.h several times slower to parse.
+ */
+
+#include <stddef.h>
+#include "unroll.h"
+
+/**
+ * Whether no index in the pack appears twice.
+ */
+template<size_t... I>
+struct t_swizzle_unique;
+
+template<size_t H, size_t... R>
+struct t_swizzle_not_in;
+
+template<size_t H>
+struct t_swizzle_not_in<H> {
+	static constexpr bool value = true;
+};
+
+template<size_t H, size_t N, size_t... R>
+struct t_swizzle_not_in<H, N, R...> {
+	static constexpr bool value = H != N && t_swizzle_not_in<H, R...>::value;
+};
+
+template<>
+struct t_swizzle_unique<> {
+	static constexpr bool value = true;
+};
+
+template<size_t H, size_t... R>
+struct t_swizzle_unique<H, R...> {
+	static constexpr bool value = t_swizzle_not_in<H, R...>::value &&
+		t_swizzle_unique<R...>::value;
+};
+
+/*
+ * Component-wise operator 'op' with a vector and with a scalar, as a new
+ * vector and in place. In place, a vector operand is copied first so
+ * v.zyx() += v is safe.
+ */
+#define T_SWZ_OPERATORS(op)                                                 \
+	T_VEC_INLINE t_vecx operator op(const t_vecx &in) const {               \
+		t_vecx out;                                                         \
+		T_VEC_EACH(k, len, out[k] = src[idx[k]] op in[k]);                  \
+		return out;                                                         \
+	}                                                                       \
+	T_VEC_INLINE t_vecx operator op(T in) const {                           \
+		t_vecx out;                                                         \
+		T_VEC_EACH(k, len, out[k] = src[idx[k]] op in);                     \
+		return out;                                                         \
+	}                                                                       \
+	T_VEC_INLINE t_swizzle& operator op##=(const t_vecx &in) {              \
+		const t_vecx v(in);                                                 \
+		T_VEC_EACH(k, len, lane(k) op##= v[k]);                             \
+		return *this;                                                       \
+	}                                                                       \
+	T_VEC_INLINE t_swizzle& operator op##=(T in) {                          \
+		T_VEC_EACH(k, len, lane(k) op##= in);                               \
+		return *this;                                                       \
+	}
+
+/**
+ * Proxy for components I... of 'src', with M the members policy (const for
+ * read-only swizzles) and t_vecx the vector type it converts to.
+ */
+template<typename M, typename t_vecx, size_t... I>
+struct t_swizzle {
+private:
+	typedef typename t_vecx::value_type T;
+	static constexpr size_t len = sizeof...(I);
+	static constexpr size_t idx[len] = { I... };
+	M &src;
+
+	T_VEC_INLINE T& lane(size_t k) {
+		static_assert(t_swizzle_unique<I...>::value,
+				"swizzle with repeated components is read-only");
+		return src[idx[k]];
+	}
+
+public:
+	T_VEC_INLINE t_swizzle(M &src) : src(src) {}
+
+	T_VEC_INLINE t_vecx get() const {
+		t_vecx out;
+		T_VEC_EACH(k, len, out[k] = src[idx[k]]);
+		return out;
+	}
+
+	T_VEC_INLINE operator t_vecx() const {
+		return get();
+	}
+
+	T_VEC_INLINE T operator[](size_t k) const {
+		return src[idx[k]];
+	}
+
+	/**********************************
+	 * Assignment
+	 **********************************/
+
+	/* 'in' is copied first, so v.zyx() = v is safe. */
+	T_VEC_INLINE t_swizzle& operator=(const t_vecx &in) {
+		const t_vecx v(in);
+		T_VEC_EACH(k, len, lane(k) = v[k]);
+		return *this;
+	}
+
+	T_VEC_INLINE t_swizzle& operator=(const t_swizzle &in) {
+		return *this = in.get();
+	}
+
+	/**********************************
+	 * Operators
+	 **********************************/
+
+	T_SWZ_OPERATORS(+)
+	T_SWZ_OPERATORS(-)
+	T_SWZ_OPERATORS(*)
+	T_SWZ_OPERATORS(/)
+
+	T_VEC_INLINE t_vecx operator-() const {
+		t_vecx out;
+		T_VEC_EACH(k, len, out[k] = -src[idx[k]]);
+		return out;
+	}
+
+	T_VEC_INLINE bool operator==(const t_vecx &in) const {
+		T_VEC_EACH(k, len, if(src[idx[k]] != in[k]) return false);
+		return true;
+	}
+
+	T_VEC_INLINE bool operator!=(const t_vecx &in) const {
+		return !(*this == in);
+	}
+};
+
+template<typename M, typename t_vecx, size_t... I>
+constexpr size_t t_swizzle<M, t_vecx, I...>::idx[];
+
+#undef T_SWZ_OPERATORS
+
+/**
+ * Accessor pair for one swizzle. Expects 'members_type' and 'T' in scope, and
+ * t_vec2/t_vec3/t_vec4 to have been declared.
+ */
+#define T_VEC_SWIZZLE(name, n, ...)                                         \
+	t_swizzle<members_type, t_vec##n<T>, __VA_ARGS__> name() {              \
+		return t_swizzle<members_type, t_vec##n<T>, __VA_ARGS__>(*this);    \
+	}                                                                       \
+	t_swizzle<const members_type, t_vec##n<T>, __VA_ARGS__> name() const {  \
+		return t_swizzle<const members_type, t_vec##n<T>, __VA_ARGS__>(     \
+				*this);                                                     \
+	}
+
+/**
+ * Component names by set and index, pasted together into accessor names.
+ */
+#define T_SWZ_xyzw_0 x
+#define T_SWZ_xyzw_1 y
+#define T_SWZ_xyzw_2 z
+#define T_SWZ_xyzw_3 w
+#define T_SWZ_rgba_0 r
+#define T_SWZ_rgba_1 g
+#define T_SWZ_rgba_2 b
+#define T_SWZ_rgba_3 a
+
+#define T_SWZ_NAME(N, i) T_SWZ_##N##_##i
+#define T_SWZ_CAT2_(a, b) a##b
+#define T_SWZ_CAT2(a, b) T_SWZ_CAT2_(a, b)
+#define T_SWZ_CAT3(a, b, c) T_SWZ_CAT2(T_SWZ_CAT2(a, b), c)
+#define T_SWZ_CAT4(a, b, c, d) T_SWZ_CAT2(T_SWZ_CAT3(a, b, c), d)
+
+#define T_SWZ_OUT2(S, N, a, b) T_VEC_SWIZZLE(                                \
+	T_SWZ_CAT2(T_SWZ_NAME(N, a), T_SWZ_NAME(N, b)), 2, a, b)
+#define T_SWZ_OUT3(S, N, a, b, c) T_VEC_SWIZZLE(                             \
+	T_SWZ_CAT3(T_SWZ_NAME(N, a), T_SWZ_NAME(N, b), T_SWZ_NAME(N, c)),        \
+	3, a, b, c)
+#define T_SWZ_OUT4(S, N, a, b, c, d) T_VEC_SWIZZLE(                          \
+	T_SWZ_CAT4(T_SWZ_NAME(N, a), T_SWZ_NAME(N, b), T_SWZ_NAME(N, c),         \
+		T_SWZ_NAME(N, d)), 4, a, b, c, d)
+
+/**
+ * F(S, N, indices..., i) for each index i of an S component vector. A macro
+ * cannot expand inside itself, so there is one copy per nesting level (A-D).
+ * Indices chosen so far are passed with a trailing comma.
+ */
+#define T_SWZ_A2(F, S, N, ...) F(S, N, __VA_ARGS__ 0) F(S, N, __VA_ARGS__ 1)
+#define T_SWZ_A3(F, S, N, ...) T_SWZ_A2(F, S, N, __VA_ARGS__) F(S, N, __VA_ARGS__ 2)
+#define T_SWZ_A4(F, S, N, ...) T_SWZ_A3(F, S, N, __VA_ARGS__) F(S, N, __VA_ARGS__ 3)
+#define T_SWZ_B2(F, S, N, ...) F(S, N, __VA_ARGS__ 0) F(S, N, __VA_ARGS__ 1)
+#define T_SWZ_B3(F, S, N, ...) T_SWZ_B2(F, S, N, __VA_ARGS__) F(S, N, __VA_ARGS__ 2)
+#define T_SWZ_B4(F, S, N, ...) T_SWZ_B3(F, S, N, __VA_ARGS__) F(S, N, __VA_ARGS__ 3)
+#define T_SWZ_C2(F, S, N, ...) F(S, N, __VA_ARGS__ 0) F(S, N, __VA_ARGS__ 1)
+#define T_SWZ_C3(F, S, N, ...) T_SWZ_C2(F, S, N, __VA_ARGS__) F(S, N, __VA_ARGS__ 2)
+#define T_SWZ_C4(F, S, N, ...) T_SWZ_C3(F, S, N, __VA_ARGS__) F(S, N, __VA_ARGS__ 3)
+#define T_SWZ_D2(F, S, N, ...) F(S, N, __VA_ARGS__ 0) F(S, N, __VA_ARGS__ 1)
+#define T_SWZ_D3(F, S, N, ...) T_SWZ_D2(F, S, N, __VA_ARGS__) F(S, N, __VA_ARGS__ 2)
+#define T_SWZ_D4(F, S, N, ...) T_SWZ_D3(F, S, N, __VA_ARGS__) F(S, N, __VA_ARGS__ 3)
+
+/* Steps for 2, 3 and 4 component swizzles. */
+#define T_SWZ_2B(S, N, ...) T_SWZ_B##S(T_SWZ_OUT2, S, N, __VA_ARGS__,)
+#define T_SWZ_3B(S, N, ...) T_SWZ_B##S(T_SWZ_3C, S, N, __VA_ARGS__,)
+#define T_SWZ_3C(S, N, ...) T_SWZ_C##S(T_SWZ_OUT3, S, N, __VA_ARGS__,)
+#define T_SWZ_4B(S, N, ...) T_SWZ_B##S(T_SWZ_4C, S, N, __VA_ARGS__,)
+#define T_SWZ_4C(S, N, ...) T_SWZ_C##S(T_SWZ_4D, S, N, __VA_ARGS__,)
+#define T_SWZ_4D(S, N, ...) T_SWZ_D##S(T_SWZ_OUT4, S, N, __VA_ARGS__,)
+
+/**
+ * Every 2 to 4 component swizzle of an S component vector, named from set N
+ * (xyzw or rgba).
+ */
+#define T_VEC_SWIZZLE_SET(S, N)                                              \
+	T_SWZ_A##S(T_SWZ_2B, S, N,)                                              \
+	T_SWZ_A##S(T_SWZ_3B, S, N,)                                              \
+	T_SWZ_A##S(T_SWZ_4B, S, N,)
+
+/**
+ * Accessors for an S component vector: all of them with T_VEC_SWIZZLE_ALL,
+ * otherwise the 2 and 3 component xyzw swizzles.
+ */
+#if defined(T_VEC_SWIZZLE_ALL)
+#define T_VEC_SWIZZLES(S)                                                    \
+	T_VEC_SWIZZLE_SET(S, xyzw)                                               \
+	T_VEC_SWIZZLE_SET(S, rgba)
+#else
+#define T_VEC_SWIZZLES(S)                                                    \
+	T_SWZ_A##S(T_SWZ_2B, S, xyzw,)                                           \
+	T_SWZ_A##S(T_SWZ_3B, S, xyzw,)
+#endif
+
+#endif
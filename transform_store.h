@@ -0,0 +1,212 @@
+#ifndef TRANSFORM_STORE_H
+#define TRANSFORM_STORE_H
+
+/**
+ * Multi-buffered array of transforms, written by one thread and read by up to
+ * 'max_readers' others without locks.
+ *
+ * The writer fills its back buffer through write() and mark(), then publish()
+ * makes it the latest buffer. Readers acquire the latest buffer as a
+ * consistent snapshot, holding a reference count on it until release(). The
+ * writer never reuses a buffer that is latest or referenced, and there are
+ * max_readers + 2 buffers, so neither side ever waits on the other.
+ *
+ * The array is split into blocks, each with a version per buffer. When a
+ * buffer becomes the writer's back buffer again only the blocks marked since
+ * it was last current are copied into it, so unchanged ranges cost nothing.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template<typename matT, size_t max_readers = 2>
+struct t_transform_store {
+	typedef matT value_type;
+	static constexpr size_t slots = max_readers + 2;
+
+private:
+	size_t count;
+	size_t block;
+	size_t blocks;
+	matT *buffers;
+
+	/* Writer only: version of each block, per buffer and latest. */
+	uint64_t *versions;
+	bool *dirty;
+	uint64_t frame;
+	size_t back;
+
+	std::atomic<size_t> latest;
+	mutable std::atomic<int> refs[slots];
+
+	matT* slot_data(size_t slot) const {
+		return buffers + slot * count;
+	}
+
+	uint64_t* slot_versions(size_t slot) const {
+		return versions + slot * blocks;
+	}
+
+	/**
+	 * Copy into 'slot' every block that changed since it was last written.
+	 */
+	void catch_up(size_t slot, size_t from) {
+		const uint64_t *want = slot_versions(slots);
+		uint64_t *have = slot_versions(slot);
+		const matT *src = slot_data(from);
+		matT *dst = slot_data(slot);
+
+		for(size_t b = 0; b < blocks; ++b) {
+			if(have[b] == want[b])
+				continue;
+
+			size_t last = (b + 1) * block < count ? (b + 1) * block : count;
+			for(size_t i = b * block; i < last; ++i)
+				dst[i] = src[i];
+			have[b] = want[b];
+		}
+	}
+
+public:
+	t_transform_store(size_t count, size_t block = 256) :
+		count(count),
+		block(block ? block : 1),
+		blocks((count + this->block - 1) / this->block),
+		buffers(new matT[count * slots]),
+		versions(new uint64_t[blocks * (slots + 1)]()),
+		dirty(new bool[blocks]()),
+		frame(0),
+		back(1),
+		latest(0) {
+		for(size_t i = 0; i < slots; ++i)
+			refs[i] = 0;
+	}
+
+	~t_transform_store() {
+		delete[] buffers;
+		delete[] versions;
+		delete[] dirty;
+	}
+
+	t_transform_store(const t_transform_store&) = delete;
+	t_transform_store& operator=(const t_transform_store&) = delete;
+
+	size_t size() const {
+		return count;
+	}
+
+	/**********************************
+	 * Writer
+	 **********************************/
+
+	/**
+	 * The back buffer, holding the latest published contents. Any element
+	 * changed must be reported through mark() before publish().
+	 */
+	matT* write() {
+		return slot_data(back);
+	}
+
+	void mark(size_t first, size_t n) {
+		if(n == 0)
+			return;
+		for(size_t b = first / block; b <= (first + n - 1) / block; ++b)
+			dirty[b] = true;
+	}
+
+	/**
+	 * Make the back buffer the latest snapshot, then bring the next back
+	 * buffer up to date.
+	 */
+	void publish() {
+		uint64_t *want = slot_versions(slots);
+		uint64_t *have = slot_versions(back);
+
+		++frame;
+		for(size_t b = 0; b < blocks; ++b) {
+			if(dirty[b]) {
+				want[b] = frame;
+				have[b] = frame;
+				dirty[b] = false;
+			}
+		}
+
+		size_t published = back;
+		latest.store(published);
+
+		/*
+		 * A free buffer always exists: at most max_readers are referenced,
+		 * and one more is latest. Readers that raced past this check
+		 * re-validate against 'latest' and back off.
+		 */
+		for(size_t s = 0;; s = (s + 1) % slots) {
+			if(s != published && refs[s].load() == 0) {
+				back = s;
+				break;
+			}
+		}
+
+		catch_up(back, published);
+	}
+
+	/**********************************
+	 * Readers
+	 **********************************/
+
+	/**
+	 * The latest snapshot. 'slot' must be passed to release() when done.
+	 */
+	const matT* acquire(size_t &slot) const {
+		for(;;) {
+			size_t s = latest.load();
+			refs[s].fetch_add(1);
+			if(latest.load() == s) {
+				slot = s;
+				return slot_data(s);
+			}
+			refs[s].fetch_sub(1);
+		}
+	}
+
+	void release(size_t slot) const {
+		refs[slot].fetch_sub(1);
+	}
+};
+
+/**
+ * Scoped reader snapshot of a t_transform_store.
+ */
+template<typename storeT>
+struct t_transform_snapshot {
+private:
+	const storeT &store;
+	size_t slot;
+	const typename storeT::value_type *ptr;
+
+public:
+	t_transform_snapshot(const storeT &store) : store(store) {
+		ptr = store.acquire(slot);
+	}
+
+	~t_transform_snapshot() {
+		store.release(slot);
+	}
+
+	t_transform_snapshot(const t_transform_snapshot&) = delete;
+	t_transform_snapshot& operator=(const t_transform_snapshot&) = delete;
+
+	const typename storeT::value_type& operator[](size_t i) const {
+		return ptr[i];
+	}
+
+	const typename storeT::value_type* data() const {
+		return ptr;
+	}
+
+	size_t size() const {
+		return store.size();
+	}
+};
+
+#endif
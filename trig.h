@@ -0,0 +1,169 @@
+#ifndef TRIG_H
+#define TRIG_H
+
+/**
+ * Sine, cosine and tangent for the vector and matrix functions.
+ *
+ * sin_cos() computes both results at once. Floats are evaluated in float with
+ * minimax polynomials after a three part Cody-Waite reduction by pi/2, which
+ * is branchless, so the array and vec4 overloads vectorise. Results are within
+ * 2 ulp (tangent 3) in [-pi/4, pi/4]. Beyond that the reduction adds an
+ * absolute error: sine and cosine stay within 1 ulp of 1 up to
+ * TRIG_REDUCE_LIMIT, but lose relative accuracy close to their zeros (up to
+ * 14 ulp within a few turns). Larger inputs fall back to libm, as do types
+ * other than float. main.cpp checks these bounds.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "vec.h"
+
+#define TRIG_REDUCE_LIMIT 8192.0f
+
+template<typename T>
+static void sin_cos(T in, T &s, T &c) {
+	s = sin(in);
+	c = cos(in);
+}
+
+/**
+ * Reduce 'in' to r in [-pi/4, pi/4] with in = r + q * pi/2, returning q and
+ * sin(r), cos(r). Valid for |in| <= TRIG_REDUCE_LIMIT.
+ */
+inline int sin_cos_reduced(float in, float &ps, float &pc) {
+	const float two_over_pi = 0.636619772367581343f;
+	const float pio2_1 = 1.5703125f;
+	const float pio2_2 = 4.837512969970703125e-4f;
+	const float pio2_3 = 7.54978995489188216e-8f;
+
+	/*
+	 * Round to nearest by adding 1.5 * 2^23, leaving the integer in the low
+	 * mantissa bits. Unlike floorf or an int conversion this vectorises, and
+	 * stays defined for out of range inputs.
+	 */
+	const float round_magic = 12582912.0f;
+	float t = in * two_over_pi + round_magic;
+	float j = t - round_magic;
+	int q;
+	memcpy(&q, &t, sizeof(q));
+	float r = ((in - j * pio2_1) - j * pio2_2) - j * pio2_3;
+	float r2 = r * r;
+
+	ps = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f +
+				r2 * -1.9515295891e-4f));
+	pc = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f +
+			r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+	return q & 3;
+}
+
+inline void sin_cos_poly(float in, float &s, float &c) {
+	float ps, pc;
+	int q = sin_cos_reduced(in, ps, pc);
+	float ss = (q & 1) ? pc : ps;
+	float cc = (q & 1) ? ps : pc;
+	s = (q & 2) ? -ss : ss;
+	c = ((q + 1) & 2) ? -cc : cc;
+}
+
+inline void sin_cos(float in, float &s, float &c) {
+	if(fabsf(in) > TRIG_REDUCE_LIMIT) {
+		s = sinf(in);
+		c = cosf(in);
+		return;
+	}
+	sin_cos_poly(in, s, c);
+}
+
+/**
+ * sin_cos of 'count' values. Either output may be null.
+ */
+template<typename T>
+static void sin_cos(const T *in, T *s, T *c, size_t count) {
+	for(size_t i = 0; i < count; ++i) {
+		T si, ci;
+		sin_cos(in[i], si, ci);
+		if(s)
+			s[i] = si;
+		if(c)
+			c[i] = ci;
+	}
+}
+
+inline void sin_cos(const float *in, float *s, float *c, size_t count) {
+	if(!s || !c) {
+		for(size_t i = 0; i < count; ++i) {
+			float si, ci;
+			sin_cos(in[i], si, ci);
+			if(s)
+				s[i] = si;
+			if(c)
+				c[i] = ci;
+		}
+		return;
+	}
+
+	for(size_t i = 0; i < count; ++i) {
+		float si, ci;
+		sin_cos_poly(in[i], si, ci);
+		s[i] = si;
+		c[i] = ci;
+	}
+
+	for(size_t i = 0; i < count; ++i) {
+		if(fabsf(in[i]) > TRIG_REDUCE_LIMIT) {
+			s[i] = sinf(in[i]);
+			c[i] = cosf(in[i]);
+		}
+	}
+}
+
+template<typename T>
+static void sin_cos(const t_vec4<T> &in, t_vec4<T> &s, t_vec4<T> &c) {
+	for(size_t i = 0; i < 4; ++i)
+		sin_cos(in[i], s[i], c[i]);
+}
+
+/**
+ * As the array overload: all four lanes through the polynomials, then any
+ * lane beyond TRIG_REDUCE_LIMIT redone with libm. 'in' is copied first, so
+ * it may alias either output.
+ */
+inline void sin_cos(const t_vec4<float> &in, t_vec4<float> &s,
+		t_vec4<float> &c) {
+	float x[4], si[4], ci[4];
+
+	for(size_t i = 0; i < 4; ++i)
+		x[i] = in[i];
+
+	for(size_t i = 0; i < 4; ++i)
+		sin_cos_poly(x[i], si[i], ci[i]);
+
+	for(size_t i = 0; i < 4; ++i) {
+		if(fabsf(x[i]) > TRIG_REDUCE_LIMIT) {
+			si[i] = sinf(x[i]);
+			ci[i] = cosf(x[i]);
+		}
+		s[i] = si[i];
+		c[i] = ci[i];
+	}
+}
+
+template<typename T>
+static T tangent(T in) {
+	return tan(in);
+}
+
+/**
+ * Divides the reduced sine and cosine rather than the final ones, keeping
+ * accuracy near the poles.
+ */
+inline float tangent(float in) {
+	if(fabsf(in) > TRIG_REDUCE_LIMIT)
+		return tanf(in);
+
+	float ps, pc;
+	int q = sin_cos_reduced(in, ps, pc);
+	return (q & 1) ? -pc / ps : ps / pc;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef UNROLL_H
+#define UNROLL_H
+
+/**
+ * Code generation helpers for the vector and matrix types, aimed at builds
+ * with little or no optimisation.
+ *
+ * T_VEC_EACH writes out component loops of up to four iterations in full, so
+ * the 2-4 component types run no loop, even at -O0. It also keeps optimised
+ * builds from leaving short loops over stack temporaries in place.
+ *
+ * Defining T_VEC_FORCE_INLINE before including the headers marks every
+ * operator, accessor and constructor always_inline, and the larger matrix
+ * functions flatten. Debug builds then compile each expression down to
+ * direct member arithmetic rather than a chain of calls, at the cost of
+ * larger debug binaries and less useful stepping.
+ */
+
+#include <stddef.h>
+
+#if defined(T_VEC_FORCE_INLINE) && (defined(__GNUC__) || defined(__clang__))
+#define T_VEC_INLINE inline __attribute__((always_inline))
+#define T_VEC_FLATTEN __attribute__((flatten))
+#elif defined(T_VEC_FORCE_INLINE) && defined(_MSC_VER)
+#define T_VEC_INLINE __forceinline
+#define T_VEC_FLATTEN
+#else
+#define T_VEC_INLINE inline
+#define T_VEC_FLATTEN
+#endif
+
+/**
+ * Run the statement(s) for each 'i' in [0, n), where n is a compile time
+ * constant. Branches on n fold away at every optimisation level.
+ */
+#define T_VEC_EACH(i, n, ...)                                              \
+	do {                                                                   \
+		if((n) > 4) {                                                      \
+			for(size_t i = 0; i < (n); ++i) { __VA_ARGS__; }               \
+			break;                                                         \
+		}                                                                  \
+		if((n) > 0) { const size_t i = 0; __VA_ARGS__; }                   \
+		if((n) > 1) { const size_t i = 1; __VA_ARGS__; }                   \
+		if((n) > 2) { const size_t i = 2; __VA_ARGS__; }                   \
+		if((n) > 3) { const size_t i = 3; __VA_ARGS__; }                   \
+	} while(0)
+
+#define T_VEC_BULK_BLOCK 64
+
+/**
+ * Run the statement(s) for each 'i' in [0, n), with n known only at run time.
+ * Whole blocks of T_VEC_BULK_BLOCK have a fixed trip count, which GCC's -O2
+ * cost model needs before it will vectorise; the remainder runs as a plain
+ * loop.
+ */
+#define T_VEC_BLOCKED(i, n, ...)                                           \
+	do {                                                                   \
+		size_t i##_block = 0;                                              \
+		for(; i##_block + T_VEC_BULK_BLOCK <= (n);                         \
+				i##_block += T_VEC_BULK_BLOCK) {                           \
+			for(size_t i##_j = 0; i##_j < T_VEC_BULK_BLOCK; ++i##_j) {     \
+				const size_t i = i##_block + i##_j;                        \
+				__VA_ARGS__;                                               \
+			}                                                              \
+		}                                                                  \
+		for(size_t i = i##_block; i < (n); ++i) { __VA_ARGS__; }           \
+	} while(0)
+
+#endif
@@ -10,6 +10,12 @@
  */
 
 #include <math.h>
+#include "unroll.h"
+#include "swizzle.h"
+
+template<typename T> struct t_vec2;
+template<typename T> struct t_vec3;
+template<typename T> struct t_vec4;
 
 /**
  * Default member for vector types simply leads back to an array.
@@ -20,16 +26,83 @@ protected:
 	T data[len] = { 0 };
 
 public:
-	T& operator[](size_t i) {
+	T_VEC_INLINE T& operator[](size_t i) {
 		return data[i];
 	}
 
-	const T& operator[](size_t i) const {
+	T_VEC_INLINE const T& operator[](size_t i) const {
 		return data[i];
 	}
 
 };
 
+/**
+ * Cubic basis weights at 't' for the four control values of a segment.
+ * Hermite takes (p0, m0, p1, m1); the others take four points.
+ */
+template<typename T>
+T_VEC_INLINE void hermite_weights(T t, T *w) {
+	T t2 = t * t;
+	T t3 = t2 * t;
+	w[0] = 2 * t3 - 3 * t2 + 1;
+	w[1] = t3 - 2 * t2 + t;
+	w[2] = -2 * t3 + 3 * t2;
+	w[3] = t3 - t2;
+}
+
+template<typename T>
+T_VEC_INLINE void catmull_rom_weights(T t, T *w) {
+	T t2 = t * t;
+	T t3 = t2 * t;
+	T half = static_cast<T>(0.5);
+	w[0] = half * (-t3 + 2 * t2 - t);
+	w[1] = half * (3 * t3 - 5 * t2 + 2);
+	w[2] = half * (-3 * t3 + 4 * t2 + t);
+	w[3] = half * (t3 - t2);
+}
+
+template<typename T>
+T_VEC_INLINE void bezier_weights(T t, T *w) {
+	T s = 1 - t;
+	w[0] = s * s * s;
+	w[1] = 3 * t * s * s;
+	w[2] = 3 * t * t * s;
+	w[3] = t * t * t;
+}
+
+template<typename T>
+T_VEC_INLINE void bspline_weights(T t, T *w) {
+	T t2 = t * t;
+	T t3 = t2 * t;
+	T sixth = static_cast<T>(1) / 6;
+	T s = 1 - t;
+	w[0] = s * s * s * sixth;
+	w[1] = (3 * t3 - 6 * t2 + 4) * sixth;
+	w[2] = (-3 * t3 + 3 * t2 + 3 * t + 1) * sixth;
+	w[3] = t3 * sixth;
+}
+
+/**
+ * Flat loops behind the t_vec bulk functions: out[i] = f(a[i], b[i]), and
+ * the in place forms io[i] = f(io[i], b[i]) and io[i] = f(io[i]).
+ */
+template<typename T, typename F>
+inline void bulk_apply(const T *__restrict a, const T *__restrict b,
+		T *__restrict out, size_t n, F f) {
+	T_VEC_BLOCKED(i, n, out[i] = f(a[i], b[i]));
+}
+
+template<typename T, typename F>
+inline void bulk_apply(T *__restrict io, const T *__restrict b, size_t n,
+		F f) {
+	T_VEC_BLOCKED(i, n, io[i] = f(io[i], b[i]));
+}
+
+template<typename T, typename F>
+inline void bulk_apply(T *__restrict io, size_t n, F f) {
+	T_VEC_BLOCKED(i, n, io[i] = f(io[i]));
+}
+
 template<typename T, size_t len, typename t_vecx,
 	typename members = t_vec_members<T, len>>
 struct t_vec : members {
@@ -38,25 +111,48 @@ private:
 	/**
 	 * Copy construct 'this' to a t_vecx type.
 	 */
-	t_vecx this_to_vecx() const {
-		t_vecx out;
-		for(size_t i = 0; i < len; ++i)
-			out[i] = data(i);
-		return out;
+	T_VEC_INLINE t_vecx this_to_vecx() const {
+		return static_cast<const t_vecx&>(*this);
+	}
+
+	/**
+	 * out = f(a, b) per component of 'count' vectors, as flat arrays. 'out'
+	 * may be 'a' and/or 'b', which selects an in place loop so every pointer
+	 * in the loop stays unaliased.
+	 */
+	template<typename F>
+	static void bulk(const t_vecx *a, const t_vecx *b, t_vecx *out,
+			size_t count, F f) {
+		static_assert(sizeof(t_vecx) == len * sizeof(T),
+				"bulk functions need vectors without padding");
+		const T *x = reinterpret_cast<const T*>(a);
+		const T *y = reinterpret_cast<const T*>(b);
+		T *o = reinterpret_cast<T*>(out);
+		size_t n = count * len;
+
+		if(o == x && o == y)
+			bulk_apply(o, n, [f](T v) { return f(v, v); });
+		else if(o == x)
+			bulk_apply(o, y, n, f);
+		else if(o == y)
+			bulk_apply(o, x, n, [f](T v, T u) { return f(u, v); });
+		else
+			bulk_apply(x, y, o, n, f);
 	}
 
 public:
+	typedef T value_type;
 	static constexpr size_t length = len;
 
-	size_t m_length() const {
+	T_VEC_INLINE size_t m_length() const {
 		return len;
 	}
 
-	T& data(size_t i) {
+	T_VEC_INLINE T& data(size_t i) {
 		return (*this)[i];
 	}
 
-	const T& data(size_t i) const {
+	T_VEC_INLINE const T& data(size_t i) const {
 		return (*this)[i];
 	}
 
@@ -64,24 +160,20 @@ public:
 	 * Construction and assignment
 	 **********************************/
 
-	t_vec() {
-		for(size_t i = 0; i < len; ++i)
-			data(i) = 0;
+	T_VEC_INLINE t_vec() {
+		T_VEC_EACH(i, len, data(i) = 0);
 	}
 
-	t_vec(const t_vecx &other) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) = other[i];
+	T_VEC_INLINE t_vec(const t_vecx &other) {
+		T_VEC_EACH(i, len, data(i) = other[i]);
 	}
 
-	t_vec(T in) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) = in;
+	T_VEC_INLINE t_vec(T in) {
+		T_VEC_EACH(i, len, data(i) = in);
 	}
 
-	t_vecx& operator=(const t_vecx &other) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) = other[i];
+	T_VEC_INLINE t_vecx& operator=(const t_vecx &other) {
+		T_VEC_EACH(i, len, data(i) = other[i]);
 		return static_cast<t_vecx&>(*this);
 	}
 
@@ -89,31 +181,27 @@ public:
 	 * Operators with vector
 	 **********************************/
 
-	t_vecx operator+(const t_vecx &other) const {
+	T_VEC_INLINE t_vecx operator+(const t_vecx &other) const {
 		t_vecx out = this_to_vecx();
-		for(size_t i = 0; i < len; ++i)
-			out[i] += other[i];
+		T_VEC_EACH(i, len, out[i] += other[i]);
 		return out;
 	}
 
-	t_vecx operator-(const t_vecx &other) const {
+	T_VEC_INLINE t_vecx operator-(const t_vecx &other) const {
 		t_vecx out = this_to_vecx();
-		for(size_t i = 0; i < len; ++i)
-			out[i] -= other[i];
+		T_VEC_EACH(i, len, out[i] -= other[i]);
 		return out;
 	}
 
-	t_vecx operator*(const t_vecx &other) const {
+	T_VEC_INLINE t_vecx operator*(const t_vecx &other) const {
 		t_vecx out = this_to_vecx();
-		for(size_t i = 0; i < len; ++i)
-			out[i] *= other[i];
+		T_VEC_EACH(i, len, out[i] *= other[i]);
 		return out;
 	}
 
-	t_vecx operator/(const t_vecx &other) const {
+	T_VEC_INLINE t_vecx operator/(const t_vecx &other) const {
 		t_vecx out = this_to_vecx();
-		for(size_t i = 0; i < len; ++i)
-			out[i] /= other[i];
+		T_VEC_EACH(i, len, out[i] /= other[i]);
 		return out;
 	}
 
@@ -121,27 +209,23 @@ public:
 	 * Shorthands with vector
 	 **********************************/
 
-	t_vecx& operator+=(const t_vecx &other) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) += other[i];
+	T_VEC_INLINE t_vecx& operator+=(const t_vecx &other) {
+		T_VEC_EACH(i, len, data(i) += other[i]);
 		return static_cast<t_vecx&>(*this);
 	}
 
-	t_vecx& operator-=(const t_vecx &other) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) -= other[i];
+	T_VEC_INLINE t_vecx& operator-=(const t_vecx &other) {
+		T_VEC_EACH(i, len, data(i) -= other[i]);
 		return static_cast<t_vecx&>(*this);
 	}
 
-	t_vecx& operator*=(const t_vecx &other) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) *= other[i];
+	T_VEC_INLINE t_vecx& operator*=(const t_vecx &other) {
+		T_VEC_EACH(i, len, data(i) *= other[i]);
 		return static_cast<t_vecx&>(*this);
 	}
 
-	t_vecx& operator/=(const t_vecx &other) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) /= other[i];
+	T_VEC_INLINE t_vecx& operator/=(const t_vecx &other) {
+		T_VEC_EACH(i, len, data(i) /= other[i]);
 		return static_cast<t_vecx&>(*this);
 	}
 
@@ -149,31 +233,27 @@ public:
 	 * Operators with type
 	 **********************************/
 
-	t_vecx operator+(T in) const {
+	T_VEC_INLINE t_vecx operator+(T in) const {
 		t_vecx out = this_to_vecx();
-		for(size_t i = 0; i < len; ++i)
-			out[i] += in;
+		T_VEC_EACH(i, len, out[i] += in);
 		return out;
 	}
 
-	t_vecx operator-(T in) const {
+	T_VEC_INLINE t_vecx operator-(T in) const {
 		t_vecx out = this_to_vecx();
-		for(size_t i = 0; i < len; ++i)
-			out[i] -= in;
+		T_VEC_EACH(i, len, out[i] -= in);
 		return out;
 	}
 
-	t_vecx operator*(T in) const {
+	T_VEC_INLINE t_vecx operator*(T in) const {
 		t_vecx out = this_to_vecx();
-		for(size_t i = 0; i < len; ++i)
-			out[i] *= in;
+		T_VEC_EACH(i, len, out[i] *= in);
 		return out;
 	}
 
-	t_vecx operator/(T in) const {
+	T_VEC_INLINE t_vecx operator/(T in) const {
 		t_vecx out = this_to_vecx();
-		for(size_t i = 0; i < len; ++i)
-			out[i] /= in;
+		T_VEC_EACH(i, len, out[i] /= in);
 		return out;
 	}
 
@@ -181,27 +261,23 @@ public:
 	 * Shorthands with type
 	 **********************************/
 
-	t_vecx& operator+=(T in) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) += in;
+	T_VEC_INLINE t_vecx& operator+=(T in) {
+		T_VEC_EACH(i, len, data(i) += in);
 		return static_cast<t_vecx&>(*this);
 	}
 
-	t_vecx& operator-=(T in) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) -= in;
+	T_VEC_INLINE t_vecx& operator-=(T in) {
+		T_VEC_EACH(i, len, data(i) -= in);
 		return static_cast<t_vecx&>(*this);
 	}
 
-	t_vecx& operator*=(T in) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) *= in;
+	T_VEC_INLINE t_vecx& operator*=(T in) {
+		T_VEC_EACH(i, len, data(i) *= in);
 		return static_cast<t_vecx&>(*this);
 	}
 
-	t_vecx& operator/=(T in) {
-		for(size_t i = 0; i < len; ++i)
-			data(i) /= in;
+	T_VEC_INLINE t_vecx& operator/=(T in) {
+		T_VEC_EACH(i, len, data(i) /= in);
 		return static_cast<t_vecx&>(*this);
 	}
 
@@ -209,10 +285,9 @@ public:
 	 * Negation
 	 **********************************/
 
-	t_vecx operator-() const {
+	T_VEC_INLINE t_vecx operator-() const {
 		t_vecx out;
-		for(size_t i = 0; i < len; ++i)
-			out[i] = -data(i);
+		T_VEC_EACH(i, len, out[i] = -data(i));
 		return out;
 	}
 
@@ -220,15 +295,12 @@ public:
 	 * Comparison
 	 **********************************/
 
-	bool operator==(const t_vecx &other) const {
-		for(size_t i = 0; i < len; ++i) {
-			if(data(i) != other[i])
-				return false;
-		}
+	T_VEC_INLINE bool operator==(const t_vecx &other) const {
+		T_VEC_EACH(i, len, if(data(i) != other[i]) return false);
 		return true;
 	}
 
-	bool operator!=(const t_vecx &other) const {
+	T_VEC_INLINE bool operator!=(const t_vecx &other) const {
 		return !(*this == other);
 	}
 
@@ -236,92 +308,252 @@ public:
 	 * Additional functions
 	 **********************************/
 
-	static T magnitude(const t_vecx &in) {
+	static T_VEC_INLINE T magnitude(const t_vecx &in) {
 		T out = 0;
-		for(size_t i = 0; i < len; ++i)
-			out += in[i] * in[i];
+		T_VEC_EACH(i, len, out += in[i] * in[i]);
 		return sqrt(out);
 	}
 
-	static t_vecx normalise(const t_vecx &in) {
+	static T_VEC_INLINE T distance_squared(const t_vecx &a, const t_vecx &b) {
+		T out = 0;
+		T_VEC_EACH(i, len, out += (a[i] - b[i]) * (a[i] - b[i]));
+		return out;
+	}
+
+	/* A vector with no length has no direction, and normalises to zero. */
+	static T_VEC_INLINE t_vecx normalise(const t_vecx &in) {
 		T v = magnitude(in);
+		if(v == 0)
+			return t_vecx(0);
 		t_vecx out(in);
 
-		for(size_t i = 0; i < len; ++i)
-			out[i] /= v;
+		T_VEC_EACH(i, len, out[i] /= v);
+		return out;
+	}
+
+	static T_VEC_INLINE T dot(const t_vecx &a, const t_vecx &b) {
+		T out = 0;
+		T_VEC_EACH(i, len, out += a[i] * b[i]);
+		return out;
+	}
+
+	/**********************************
+	 * Component-wise functions
+	 **********************************/
+
+	static T_VEC_INLINE t_vecx min(const t_vecx &a, const t_vecx &b) {
+		t_vecx out;
+		T_VEC_EACH(i, len, out[i] = b[i] < a[i] ? b[i] : a[i]);
+		return out;
+	}
+
+	static T_VEC_INLINE t_vecx max(const t_vecx &a, const t_vecx &b) {
+		t_vecx out;
+		T_VEC_EACH(i, len, out[i] = a[i] < b[i] ? b[i] : a[i]);
+		return out;
+	}
+
+	static T_VEC_INLINE t_vecx abs(const t_vecx &in) {
+		t_vecx out;
+		T_VEC_EACH(i, len, out[i] = in[i] < 0 ? -in[i] : in[i]);
+		return out;
+	}
+
+	static T_VEC_INLINE t_vecx clamp(const t_vecx &in, const t_vecx &lo,
+			const t_vecx &hi) {
+		return min(max(in, lo), hi);
+	}
+
+	/**
+	 * Linear interpolation, a at t = 0 and b at t = 1.
+	 */
+	static T_VEC_INLINE t_vecx lerp(const t_vecx &a, const t_vecx &b, T t) {
+		t_vecx out;
+		T_VEC_EACH(i, len, out[i] = a[i] + (b[i] - a[i]) * t);
+		return out;
+	}
+
+	/**
+	 * lerp with 't' clamped to [0, 1] and eased by 3t^2 - 2t^3. Unlike GLSL
+	 * smoothstep, this blends two values rather than mapping x between edges.
+	 */
+	static T_VEC_INLINE t_vecx smooth_lerp(const t_vecx &a, const t_vecx &b,
+			T t) {
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+		return lerp(a, b, t * t * (3 - 2 * t));
+	}
+
+	/**
+	 * w[0] * a + w[1] * b + w[2] * c + w[3] * d.
+	 */
+	static T_VEC_INLINE t_vecx blend(const t_vecx &a, const t_vecx &b,
+			const t_vecx &c, const t_vecx &d, const T *w) {
+		t_vecx out;
+		T_VEC_EACH(i, len,
+			out[i] = w[0] * a[i] + w[1] * b[i] + w[2] * c[i] + w[3] * d[i]);
 		return out;
 	}
 
-	static T dot(const t_vecx &a, const t_vecx &b) {
-		T top = 0;
-		T bottom = 0;
-		T s_a = 0;
-		T s_b = 0;
+	/**
+	 * Cubic segments, 't' in [0, 1]. Hermite runs from p0 to p1 with
+	 * tangents m0 and m1; Catmull-Rom from p1 to p2; Bezier from p0 to p3;
+	 * the uniform B-spline approximates p1 to p2.
+	 */
+	static T_VEC_INLINE t_vecx hermite(const t_vecx &p0, const t_vecx &m0,
+			const t_vecx &p1, const t_vecx &m1, T t) {
+		T w[4];
+		hermite_weights(t, w);
+		return blend(p0, m0, p1, m1, w);
+	}
+
+	static T_VEC_INLINE t_vecx catmull_rom(const t_vecx &p0, const t_vecx &p1,
+			const t_vecx &p2, const t_vecx &p3, T t) {
+		T w[4];
+		catmull_rom_weights(t, w);
+		return blend(p0, p1, p2, p3, w);
+	}
+
+	static T_VEC_INLINE t_vecx bezier(const t_vecx &p0, const t_vecx &p1,
+			const t_vecx &p2, const t_vecx &p3, T t) {
+		T w[4];
+		bezier_weights(t, w);
+		return blend(p0, p1, p2, p3, w);
+	}
 
-		for(size_t i = 0; i < len; ++i) {
-			top += a[i] * b[i];
-			s_a += a[i] * a[i];
-			s_b += b[i] * b[i];
-		}
+	static T_VEC_INLINE t_vecx bspline(const t_vecx &p0, const t_vecx &p1,
+			const t_vecx &p2, const t_vecx &p3, T t) {
+		T w[4];
+		bspline_weights(t, w);
+		return blend(p0, p1, p2, p3, w);
+	}
+
+	/**********************************
+	 * Bulk functions
+	 *
+	 * Over arrays of 'count' vectors. 'out' may be one of the
+	 * inputs, otherwise the arrays must not overlap.
+	 **********************************/
+
+	static void add(const t_vecx *a, const t_vecx *b, t_vecx *out,
+			size_t count) {
+		bulk(a, b, out, count, [](T x, T y) { return x + y; });
+	}
 
-		bottom = sqrt(s_a) * sqrt(s_b);
-		T theta = top / bottom;
-		return magnitude(a) * magnitude(b) * theta;
+	static void sub(const t_vecx *a, const t_vecx *b, t_vecx *out,
+			size_t count) {
+		bulk(a, b, out, count, [](T x, T y) { return x - y; });
+	}
+
+	static void mul(const t_vecx *a, const t_vecx *b, t_vecx *out,
+			size_t count) {
+		bulk(a, b, out, count, [](T x, T y) { return x * y; });
+	}
+
+	static void scale(const t_vecx *a, T s, t_vecx *out, size_t count) {
+		bulk(a, a, out, count, [s](T x, T) { return x * s; });
+	}
+
+	/* out = a + b * s, e.g. integrating positions by velocities. */
+	static void add_scaled(const t_vecx *a, const t_vecx *b, T s,
+			t_vecx *out, size_t count) {
+		bulk(a, b, out, count, [s](T x, T y) { return x + y * s; });
 	}
 };
 
 /**
- * operator[] declaration for named member access, starting at
- * from starting pointer 'x'.
+ * operator[] for the named vector types, indexing the array 'e'. Named and
+ * indexed access share that one array: the xyzw and rgba names are anonymous
+ * structs laid over it in a union. Indexing a real array, rather than
+ * stepping a pointer from one member to the next, lets the optimiser follow
+ * each component through loops over arrays of vectors and vectorise them;
+ * the bench.cpp script fails if its vec3 and mat4 loops stop vectorising.
+ *
+ * This layout deliberately relies on compiler behaviour beyond ISO C++.
+ * Anonymous structs are an extension. Writing x and then reading e[0] reads a
+ * union member other than the one last written, which the standard leaves
+ * undefined. The types are only meant for GCC, Clang and MSVC, which all
+ * support both. T_VEC_EXTENSION marks the structs so -Wpedantic stays quiet
+ * on GCC and Clang.
  */
-#define T_VEC_NAMED_MEMBER_ACCESS(x)           \
-	T& operator[](size_t i) {                  \
-		return (&x)[i];                        \
-	}                                          \
-	const T& operator[](size_t i) const {      \
-		return (&x)[i];                        \
-	}                                          \
+#if defined(__GNUC__) || defined(__clang__)
+#define T_VEC_EXTENSION __extension__
+#else
+#define T_VEC_EXTENSION
+#endif
 
+#define T_VEC_INDEXED_ACCESS(e)                            \
+	T_VEC_INLINE T& operator[](size_t i) {                 \
+		return e[i];                                       \
+	}                                                      \
+	T_VEC_INLINE const T& operator[](size_t i) const {     \
+		return e[i];                                       \
+	}
 
-/* Default constructor and copy constructor. */
+/*
+ * Default constructor and copy constructor. The copy is left to the compiler
+ * so the types stay trivially copyable, are passed in registers and can be
+ * copied in bulk.
+ */
 #define T_VEC_DEFAULTS(tv, tvb)                \
-	tv() {}                                    \
-	tv(T in) : tvb(in) {}                      \
-	tv(const tv &v) : tvb(v) {}
+	T_VEC_INLINE tv() {}                       \
+	T_VEC_INLINE tv(T in) : tvb(in) {}         \
+	tv(const tv &) = default;
 
 
 template<typename T>
 struct t_vec2_members {
-	T_VEC_NAMED_MEMBER_ACCESS(x)
-	union { T x, r; };
-	union { T y, g; };
+	typedef t_vec2_members members_type;
+
+	union {
+		T e[2];
+		T_VEC_EXTENSION struct { T x, y; };
+		T_VEC_EXTENSION struct { T r, g; };
+	};
+
+	T_VEC_INDEXED_ACCESS(e)
+
+	T_VEC_SWIZZLES(2)
 };
 
 template<typename T>
 struct t_vec3_members {
-	T_VEC_NAMED_MEMBER_ACCESS(x)
-	union { T x, r; };
-	union { T y, g; };
-	union { T z, b; };
+	typedef t_vec3_members members_type;
+
+	union {
+		T e[3];
+		T_VEC_EXTENSION struct { T x, y, z; };
+		T_VEC_EXTENSION struct { T r, g, b; };
+	};
+
+	T_VEC_INDEXED_ACCESS(e)
+
+	T_VEC_SWIZZLES(3)
 };
 
 template<typename T>
 struct t_vec4_members {
-	T_VEC_NAMED_MEMBER_ACCESS(x)
-	union { T x, r; };
-	union { T y, g; };
-	union { T z, b; };
-	union { T w, a; };
+	typedef t_vec4_members members_type;
+
+	union {
+		T e[4];
+		T_VEC_EXTENSION struct { T x, y, z, w; };
+		T_VEC_EXTENSION struct { T r, g, b, a; };
+	};
+
+	T_VEC_INDEXED_ACCESS(e)
+
+	T_VEC_SWIZZLES(4)
 };
 
 #define T_VEC2 t_vec<T, 2, t_vec2<T>, t_vec2_members<T>>
 #define T_VEC3 t_vec<T, 3, t_vec3<T>, t_vec3_members<T>>
 #define T_VEC4 t_vec<T, 4, t_vec4<T>, t_vec4_members<T>>
+#define T_VECN t_vec<T, len, t_vecn<T, len>>
 template<typename T>
 struct t_vec2 : T_VEC2 {
 	T_VEC_DEFAULTS(t_vec2, T_VEC2);
 
-	t_vec2(T x, T y) {
+	T_VEC_INLINE t_vec2(T x, T y) {
 		this->x = x;
 		this->y = y;
 	}
@@ -331,7 +563,7 @@ template<typename T>
 struct t_vec3 : T_VEC3 {
 	T_VEC_DEFAULTS(t_vec3, T_VEC3);
 
-	t_vec3(T x, T y, T z) {
+	T_VEC_INLINE t_vec3(T x, T y, T z) {
 		this->x = x;
 		this->y = y;
 		this->z = z;
@@ -340,7 +572,7 @@ struct t_vec3 : T_VEC3 {
 	/**
 	 * vec3-only cross product.
 	 */
-	static t_vec3 Cross(const t_vec3 &a, const t_vec3 &b) {
+	static T_VEC_INLINE t_vec3 Cross(const t_vec3 &a, const t_vec3 &b) {
 		return t_vec3(
 			a.y * b.z - a.z * b.y,
 			a.z * b.x - a.x * b.z,
@@ -353,7 +585,7 @@ template<typename T>
 struct t_vec4 : T_VEC4 {
 	T_VEC_DEFAULTS(t_vec4, T_VEC4);
 
-	t_vec4(T x, T y, T z, T w) {
+	T_VEC_INLINE t_vec4(T x, T y, T z, T w) {
 		this->x = x;
 		this->y = y;
 		this->z = z;
@@ -361,11 +593,59 @@ struct t_vec4 : T_VEC4 {
 	}
 };
 
+/**
+ * Vector of any length, with indexed access only. Used for shapes beyond the
+ * named 2-4 component types, e.g. t_vecn<float, 6>.
+ */
+template<typename T, size_t len>
+struct t_vecn : T_VECN {
+	T_VEC_DEFAULTS(t_vecn, T_VECN);
+};
+
 #undef T_VEC2
 #undef T_VEC3
 #undef T_VEC4
+#undef T_VECN
 #undef T_VEC_DEFAULTS
-#undef T_VEC_NAMED_MEMBER_ACCESS
+#undef T_VEC_INDEXED_ACCESS
+#undef T_VEC_EXTENSION
+#undef T_VEC_SWIZZLES
+#undef T_VEC_SWIZZLE_SET
+#undef T_VEC_SWIZZLE
+#undef T_SWZ_xyzw_0
+#undef T_SWZ_xyzw_1
+#undef T_SWZ_xyzw_2
+#undef T_SWZ_xyzw_3
+#undef T_SWZ_rgba_0
+#undef T_SWZ_rgba_1
+#undef T_SWZ_rgba_2
+#undef T_SWZ_rgba_3
+#undef T_SWZ_NAME
+#undef T_SWZ_CAT2_
+#undef T_SWZ_CAT2
+#undef T_SWZ_CAT3
+#undef T_SWZ_CAT4
+#undef T_SWZ_OUT2
+#undef T_SWZ_OUT3
+#undef T_SWZ_OUT4
+#undef T_SWZ_A2
+#undef T_SWZ_A3
+#undef T_SWZ_A4
+#undef T_SWZ_B2
+#undef T_SWZ_B3
+#undef T_SWZ_B4
+#undef T_SWZ_C2
+#undef T_SWZ_C3
+#undef T_SWZ_C4
+#undef T_SWZ_D2
+#undef T_SWZ_D3
+#undef T_SWZ_D4
+#undef T_SWZ_2B
+#undef T_SWZ_3B
+#undef T_SWZ_3C
+#undef T_SWZ_4B
+#undef T_SWZ_4C
+#undef T_SWZ_4D
 
 typedef t_vec2<float> vec2;
 typedef t_vec3<float> vec3;